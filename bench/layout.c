@@ -0,0 +1,77 @@
+/*
+ * Layout microbenchmark. Runs every layout in layout.h over the same number
+ * of windows until it's spent a fixed time on each, and prints the time per
+ * relayout and per window as JSON:
+ *
+ *   layout [-n windows] [-w width] [-h height]
+ *
+ * Layouts write into one preallocated array, like arrange() does, so this
+ * measures only the arithmetic of the layout itself
+ */
+
+/* Includes */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <layout.h>
+
+/* Constants */
+#define RUN_NS 200000000ll /* Time spent on each layout */
+#define BATCH 64           /* Relayouts between clock reads */
+
+/* Time */
+static int64_t now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (int64_t)time.tv_sec*1000000000 + time.tv_nsec;
+}
+
+/* Entry point */
+int main(int argc, char *argv[]) {
+  uint32_t num_windows = 1000;
+  rect_t area = { 0, 0, 1920, 1080 };
+  int option;
+  while ((option = getopt(argc, argv, "n:w:h:")) != -1) {
+    switch (option) {
+      case 'n': num_windows = strtoul(optarg, NULL, 0); break;
+      case 'w': area.width = strtoul(optarg, NULL, 0); break;
+      case 'h': area.height = strtoul(optarg, NULL, 0); break;
+      default:
+        fprintf(stderr, "Usage: %s [-n windows] [-w width] [-h height]\n", argv[0]);
+        return 1;
+    }
+  }
+  rect_t *rects = malloc(sizeof(rect_t)*(num_windows ? num_windows : 1));
+  if (!rects) return 1;
+
+  printf("{\"windows\": %u, \"layouts\": {", num_windows);
+  for (uint32_t layout = 0; layout < NUM_LAYOUTS; layout++) {
+    /* The first pass warms the cache, and checks every window got a place */
+    layout_apply(layout, area, num_windows, rects);
+    uint64_t checksum = 0;
+    for (uint32_t i = 0; i < num_windows; i++)
+      checksum += rects[i].x + rects[i].y + rects[i].width + rects[i].height;
+
+    uint64_t runs = 0;
+    int64_t start = now(), elapsed;
+    do {
+      for (uint32_t i = 0; i < BATCH; i++)
+        layout_apply(layout, area, num_windows, rects);
+      runs += BATCH;
+      elapsed = now() - start;
+    } while (elapsed < RUN_NS);
+    double per_run = (double)elapsed/runs;
+    printf(
+        "%s\"%s\": {\"runs\": %llu, \"ns_per_layout\": %.1f,"
+        " \"ns_per_window\": %.2f, \"checksum\": %llu}",
+        layout ? ", " : "", LAYOUT_NAMES[layout], (unsigned long long)runs,
+        per_run, num_windows ? per_run/num_windows : 0,
+        (unsigned long long)checksum
+    );
+  }
+  printf("}}\n");
+  free(rects);
+  return 0;
+}
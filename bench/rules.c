@@ -0,0 +1,108 @@
+/*
+ * Rule matching microbenchmark. Compiles a number of rules, half of them
+ * exact classes and half title globs, and matches windows against them until
+ * it's spent a fixed time on each kind, printing the time per window as JSON:
+ *
+ *   rules [-n rules]
+ *
+ * Windows that match a rule and windows that match none are timed apart,
+ * since a miss can stop as soon as every glob has failed
+ */
+
+/* Includes */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <rules.h>
+
+/* Constants */
+#define RUN_NS 200000000ll /* Time spent on each kind of window */
+#define BATCH 256          /* Matches between clock reads */
+#define PATTERN_SIZE 32
+
+/* Time */
+static int64_t now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (int64_t)time.tv_sec*1000000000 + time.tv_nsec;
+}
+
+/* Entry point */
+int main(int argc, char *argv[]) {
+  uint32_t num_rules = 100;
+  int option;
+  while ((option = getopt(argc, argv, "n:")) != -1) {
+    switch (option) {
+      case 'n': num_rules = strtoul(optarg, NULL, 0); break;
+      default:
+        fprintf(stderr, "Usage: %s [-n rules]\n", argv[0]);
+        return 1;
+    }
+  }
+  rule_t *rules = malloc(sizeof(rule_t)*(num_rules ? num_rules : 1));
+  char (*patterns)[PATTERN_SIZE] =
+    malloc(PATTERN_SIZE*(num_rules ? num_rules : 1));
+  if (!rules || !patterns) return 1;
+  for (uint32_t i = 0; i < num_rules; i++) {
+    rules[i] = (rule_t){ .floating = -1, .workspace = i % 9 + 1 };
+    if (i % 2) {
+      snprintf(patterns[i], PATTERN_SIZE, "*Editor %u - *", i);
+      rules[i].patterns[RULE_TITLE] = patterns[i];
+    } else {
+      snprintf(patterns[i], PATTERN_SIZE, "Application%u", i);
+      rules[i].patterns[RULE_CLASS] = patterns[i];
+    }
+  }
+
+  int64_t start = now();
+  rules_t *compiled = rules_compile(rules, num_rules);
+  int64_t compile_ns = now() - start;
+  if (!compiled) return 1;
+
+  /* The last rule of each kind, and a window like neither */
+  char hit_class[PATTERN_SIZE], hit_title[64];
+  snprintf(
+      hit_class, sizeof(hit_class), "Application%u",
+      num_rules > 1 ? (num_rules - 1) & ~1u : 0
+  );
+  snprintf(
+      hit_title, sizeof(hit_title), "notes.txt - Editor %u - ~/src",
+      num_rules > 1 ? (num_rules - 1) | 1u : 1
+  );
+  const char *windows[][RULE_FIELDS] = {
+    { hit_class, "application", "Untitled" },
+    { "Text", "text", hit_title },
+    { "Terminal", "terminal", "user@host: ~/src/pwm - vim include/rules.h" },
+  };
+  const char *names[] = { "class", "title", "miss" };
+
+  printf(
+      "{\"rules\": %u, \"compile_ns\": %lld, \"windows\": {",
+      num_rules, (long long)compile_ns
+  );
+  for (uint32_t w = 0; w < sizeof(windows)/sizeof(windows[0]); w++) {
+    rule_t result;
+    bool matched = rules_match(compiled, windows[w], &result);
+    uint64_t runs = 0;
+    int64_t begin = now(), elapsed;
+    do {
+      for (uint32_t i = 0; i < BATCH; i++)
+        rules_match(compiled, windows[w], &result);
+      runs += BATCH;
+      elapsed = now() - begin;
+    } while (elapsed < RUN_NS);
+    printf(
+        "%s\"%s\": {\"runs\": %llu, \"ns_per_window\": %.1f,"
+        " \"matched\": %s, \"workspace\": %d}",
+        w ? ", " : "", names[w], (unsigned long long)runs,
+        (double)elapsed/runs, matched ? "true" : "false", result.workspace
+    );
+  }
+  printf("}}\n");
+  rules_free(compiled);
+  free(patterns);
+  free(rules);
+  return 0;
+}
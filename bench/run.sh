@@ -0,0 +1,21 @@
+#!/bin/sh
+# Run pwm under Xvfb, storm it with synthetic clients and print the results
+# as JSON. Takes the storm's options, e.g. bench/run.sh -n 500 -r 200
+DISPLAY_NUMBER=${BENCH_DISPLAY:-99}
+BIN_DIR=${BIN_DIR:-bin}
+
+Xvfb ":$DISPLAY_NUMBER" -screen 0 1920x1080x24 -nolisten tcp -noreset \
+    >/dev/null 2>&1 &
+XVFB_PID=$!
+trap 'kill $PWM_PID $XVFB_PID 2>/dev/null' EXIT INT TERM
+# The socket shows up once the server is ready for clients
+for i in $(seq 50); do
+  [ -S "/tmp/.X11-unix/X$DISPLAY_NUMBER" ] && break
+  sleep 0.1
+done
+
+export DISPLAY=":$DISPLAY_NUMBER"
+PWM_LOG_LEVEL=error "$BIN_DIR/pwm" >/dev/null 2>&1 &
+PWM_PID=$!
+# The storm waits for pwm to take over the root window itself
+"$BIN_DIR/storm" -p "$PWM_PID" "$@"
@@ -0,0 +1,258 @@
+/*
+ * Synthetic client storm. Creates, maps, configures and destroys windows at a
+ * controlled rate against a running window manager, and prints how long the
+ * manager took to respond as JSON:
+ *
+ *   storm [-n windows] [-r windows per second] [-p wm pid]
+ *
+ * Time to map runs from the map request to the window's MapNotify, so it
+ * includes the manager's layout. Configure turnaround runs from a configure
+ * request to the first ConfigureNotify that follows it, real or synthetic.
+ * With -p, the manager's CPU time in each phase is read from /proc
+ */
+
+/* Includes */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <xcb/xcb.h>
+
+/* Constants */
+#define SETTLE_NS 200000000ll  /* Quiet time that ends a phase */
+#define TIMEOUT_NS 10000000000ll /* Longest wait for a phase's replies */
+
+/* State */
+typedef enum { PHASE_MAP, PHASE_CONFIGURE, PHASE_DESTROY } phase_t;
+static const char *PHASE_NAMES[] = { "map", "configure", "destroy" };
+#define NUM_PHASES 3
+static xcb_connection_t *connection = NULL;
+static xcb_screen_t *screen = NULL;
+static uint32_t num_windows = 200;
+static uint32_t rate = 0; /* Windows per second, 0 for as fast as possible */
+static int wm_pid = 0;
+static xcb_window_t *windows = NULL; /* Ascending, as XIDs are handed out */
+static int64_t *sent = NULL;     /* When each window's request went out */
+static int64_t *latencies = NULL; /* Nanoseconds, -1 until answered */
+
+/* Time */
+static int64_t now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (int64_t)time.tv_sec*1000000000 + time.tv_nsec;
+}
+static double wm_cpu_ms(void) {
+  if (!wm_pid) return 0;
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/stat", wm_pid);
+  FILE *file = fopen(path, "r");
+  if (!file) return 0;
+  /* utime and stime are the 14th and 15th fields, after "(comm)" */
+  unsigned long utime = 0, stime = 0;
+  int c;
+  while ((c = fgetc(file)) != EOF && c != ')');
+  if (fscanf(
+        file, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+        &utime, &stime
+      ) != 2)
+    utime = stime = 0;
+  fclose(file);
+  return (utime + stime)*1000.0/sysconf(_SC_CLK_TCK);
+}
+
+/* Windows */
+static int compare_windows(const void *a, const void *b) {
+  xcb_window_t x = *(const xcb_window_t *)a, y = *(const xcb_window_t *)b;
+  return (x > y) - (x < y);
+}
+static int64_t find_window(xcb_window_t window) {
+  xcb_window_t *found = bsearch(
+      &window, windows, num_windows, sizeof(xcb_window_t), compare_windows
+  );
+  return found ? found - windows : -1;
+}
+static void wait_for_wm(void) {
+  /*
+   * Only a manager redirects the root's substructure. Asking rather than
+   * trying it, which would make a manager starting at that moment fail
+   */
+  for (int i = 0; i < 100; i++) {
+    xcb_get_window_attributes_reply_t *attributes =
+      xcb_get_window_attributes_reply(
+          connection, xcb_get_window_attributes(connection, screen->root),
+          NULL
+      );
+    bool running = attributes
+      && attributes->all_event_masks & XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT;
+    free(attributes);
+    if (running) return;
+    nanosleep(&(struct timespec){ 0, 50000000 }, NULL);
+  }
+  fprintf(stderr, "No window manager is running\n");
+  exit(1);
+}
+
+/* Phases */
+static void send_request(phase_t phase, uint32_t i) {
+  xcb_window_t window = windows[i];
+  switch (phase) {
+    case PHASE_MAP:
+      xcb_map_window(connection, window);
+      break;
+    case PHASE_CONFIGURE: {
+      uint32_t values[4] = { i % 64, i % 32, 100 + i % 50, 100 + i % 40 };
+      xcb_configure_window(
+          connection, window,
+          XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y
+          | XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
+          values
+      );
+      break;
+    }
+    case PHASE_DESTROY:
+      xcb_destroy_window(connection, window);
+      break;
+  }
+  sent[i] = now();
+  latencies[i] = -1;
+}
+/* Returns whether the event answered one of the phase's requests */
+static bool handle_event(phase_t phase, xcb_generic_event_t *event) {
+  uint8_t type = event->response_type & ~0x80;
+  xcb_window_t window;
+  if (phase == PHASE_MAP && type == XCB_MAP_NOTIFY)
+    window = ((xcb_map_notify_event_t *)event)->window;
+  else if (phase == PHASE_CONFIGURE && type == XCB_CONFIGURE_NOTIFY)
+    window = ((xcb_configure_notify_event_t *)event)->window;
+  else if (phase == PHASE_DESTROY && type == XCB_DESTROY_NOTIFY)
+    window = ((xcb_destroy_notify_event_t *)event)->window;
+  else
+    return false;
+  int64_t i = find_window(window);
+  if (i < 0 || !sent[i] || latencies[i] >= 0) return false;
+  latencies[i] = now() - sent[i];
+  return true;
+}
+static double run_phase(phase_t phase) {
+  int64_t interval = rate ? 1000000000ll/rate : 0;
+  int64_t start = now(), next = start, last_event = start, last_answer = start;
+  uint32_t num_sent = 0, num_answered = 0;
+  memset(sent, 0, sizeof(int64_t)*num_windows);
+  struct pollfd fd = { xcb_get_file_descriptor(connection), POLLIN, 0 };
+  for (;;) {
+    int64_t time = now();
+    while (num_sent < num_windows && time >= next) {
+      send_request(phase, num_sent++);
+      next += interval;
+    }
+    xcb_flush(connection);
+    xcb_generic_event_t *event;
+    while ((event = xcb_poll_for_event(connection))) {
+      if (handle_event(phase, event)) {
+        num_answered++;
+        last_answer = now();
+      }
+      free(event);
+      last_event = now();
+    }
+    if (xcb_connection_has_error(connection)) {
+      fprintf(stderr, "Lost connection to X server\n");
+      exit(1);
+    }
+    time = now();
+    if (num_sent == num_windows) {
+      if (num_answered == num_windows && time - last_event > SETTLE_NS) break;
+      if (time - start > TIMEOUT_NS) break;
+    }
+    int64_t wait = num_sent < num_windows ? next - time : SETTLE_NS;
+    poll(&fd, 1, wait > 0 ? (int)(wait/1000000) + 1 : 0);
+  }
+  /* The settling time isn't part of the phase */
+  return (last_answer - start)/1e6;
+}
+
+/* Reporting */
+static int compare_latencies(const void *a, const void *b) {
+  int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+  return (x > y) - (x < y);
+}
+static void print_phase(phase_t phase, double wall_ms, double cpu_ms) {
+  qsort(latencies, num_windows, sizeof(int64_t), compare_latencies);
+  uint32_t missing = 0;
+  while (missing < num_windows && latencies[missing] < 0) missing++;
+  const int64_t *answered = latencies + missing;
+  uint32_t count = num_windows - missing;
+  double total = 0;
+  for (uint32_t i = 0; i < count; i++) total += answered[i];
+  printf(
+      "  \"%s\": { \"count\": %u, \"missing\": %u, \"mean_us\": %.1f, "
+      "\"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f, "
+      "\"wall_ms\": %.1f, \"wm_cpu_ms\": %.1f }",
+      PHASE_NAMES[phase], count, missing,
+      count ? total/count/1e3 : 0,
+      count ? answered[count/2]/1e3 : 0,
+      count ? answered[(count*99 - 1)/100]/1e3 : 0,
+      count ? answered[count - 1]/1e3 : 0,
+      wall_ms, cpu_ms
+  );
+}
+
+/* Entry point */
+int main(int argc, char *argv[]) {
+  int option;
+  while ((option = getopt(argc, argv, "n:r:p:")) != -1) {
+    switch (option) {
+      case 'n': num_windows = strtoul(optarg, NULL, 0); break;
+      case 'r': rate = strtoul(optarg, NULL, 0); break;
+      case 'p': wm_pid = strtol(optarg, NULL, 0); break;
+      default:
+        fprintf(stderr, "Usage: %s [-n windows] [-r rate] [-p pid]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (!num_windows) return 1;
+  connection = xcb_connect(NULL, NULL);
+  if (xcb_connection_has_error(connection)) {
+    fprintf(stderr, "Failed to connect to X server\n");
+    return 1;
+  }
+  screen = xcb_setup_roots_iterator(xcb_get_setup(connection)).data;
+  wait_for_wm();
+
+  windows = malloc(sizeof(xcb_window_t)*num_windows);
+  sent = malloc(sizeof(int64_t)*num_windows);
+  latencies = malloc(sizeof(int64_t)*num_windows);
+  if (!windows || !sent || !latencies) return 1;
+  uint32_t values[] = { screen->black_pixel, XCB_EVENT_MASK_STRUCTURE_NOTIFY };
+  for (uint32_t i = 0; i < num_windows; i++) {
+    windows[i] = xcb_generate_id(connection);
+    xcb_create_window(
+        connection, XCB_COPY_FROM_PARENT, windows[i], screen->root,
+        0, 0, 100, 100, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+        screen->root_visual, XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK, values
+    );
+  }
+  qsort(windows, num_windows, sizeof(xcb_window_t), compare_windows);
+  free(xcb_get_input_focus_reply(
+        connection, xcb_get_input_focus(connection), NULL
+  ));
+
+  printf("{\n  \"windows\": %u,\n  \"rate\": %u,\n", num_windows, rate);
+  for (phase_t phase = PHASE_MAP; phase < NUM_PHASES; phase++) {
+    double cpu = wm_cpu_ms();
+    double wall = run_phase(phase);
+    print_phase(phase, wall, wm_cpu_ms() - cpu);
+    printf(phase + 1 < NUM_PHASES ? ",\n" : "\n");
+  }
+  printf("}\n");
+
+  free(windows);
+  free(sent);
+  free(latencies);
+  xcb_disconnect(connection);
+  return 0;
+}
@@ -0,0 +1,75 @@
+/* Include guard */
+#ifndef ALLOC_H
+#define ALLOC_H
+
+/* Includes */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Bump arena for data that only lives for one pass of the event loop, reset
+ * all at once at the end of it. Allocations that don't fit spill into blocks
+ * of their own until the next reset, which regrows the arena to the most a
+ * pass has needed, so a steady workload stops touching malloc() at all
+ */
+typedef struct arena_block arena_block_t;
+typedef struct {
+  char *base;
+  size_t size;
+  size_t used;
+  arena_block_t *spilled; /* Blocks allocated since the last reset */
+  size_t spilled_size;
+  /* Counters */
+  size_t peak;            /* Most used in one pass, spills included */
+  uint64_t resets;
+  uint64_t allocations;
+  uint64_t spills;
+  uint64_t grows;
+} arena_t;
+
+extern void arena_init(arena_t *arena, size_t size);
+/* Never fails, aligned for any type. Valid until the next arena_reset() */
+extern void *arena_alloc(arena_t *arena, size_t size);
+extern void arena_reset(arena_t *arena);
+extern void arena_free(arena_t *arena);
+
+/*
+ * Slab pool of fixed-size records. Records come from chunks that are never
+ * freed or moved, so a record's address and index stay the same for as long
+ * as it's allocated, and freed ones are reused before any chunk is added.
+ * Free records are tracked outside them, so their memory is left as it was
+ */
+typedef struct {
+  size_t record_size;
+  uint32_t chunk_records;
+  char **chunks;
+  uint32_t num_chunks;
+  uint32_t *free_records; /* Indices, used as a stack */
+  uint32_t num_free;
+  bool *allocated;        /* By index, so a record can't be freed twice */
+  /* Counters */
+  uint32_t used;
+  uint32_t peak;
+  uint64_t allocations;
+} pool_t;
+
+extern void pool_init(pool_t *pool, size_t record_size, uint32_t chunk_records);
+/* Zeroed, or NULL when out of memory. Sets index if it isn't NULL */
+extern void *pool_alloc(pool_t *pool, uint32_t *index);
+/* False, changing nothing, unless the record is allocated at that index */
+extern bool pool_release(pool_t *pool, void *record, uint32_t index);
+/* Any record ever handed out, allocated or not, or NULL past the end */
+extern void *pool_get(const pool_t *pool, uint32_t index);
+extern uint32_t pool_capacity(const pool_t *pool);
+extern void pool_free(pool_t *pool);
+
+/* One line of counters each, returning the length like snprintf() */
+extern size_t arena_format(
+    char *buffer, size_t size, const char *name, const arena_t *arena
+);
+extern size_t pool_format(
+    char *buffer, size_t size, const char *name, const pool_t *pool
+);
+
+#endif /* ALLOC_H */
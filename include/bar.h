@@ -0,0 +1,64 @@
+/* Include guard */
+#ifndef BAR_H
+#define BAR_H
+
+/* Includes */
+#include <stdint.h>
+#include <stdbool.h>
+#include <render.h> /* For render_job_t */
+
+/*
+ * Status bar segments. Each segment is a run of text with its colours, packed
+ * from the left, from the right, or filling whatever's between. Laying the
+ * bar out fingerprints every segment's text, colours and place, and only the
+ * segments whose fingerprint changed since they were last drawn are marked
+ * dirty, so setting the same content again draws nothing
+ */
+#define BAR_MAX_SEGMENTS 32
+
+typedef enum {
+  BAR_LEFT,
+  BAR_FILL,  /* Takes the space the others leave, text cut short to fit */
+  BAR_RIGHT
+} bar_side_t;
+typedef struct {
+  /* What it shows, set by bar_set() */
+  bar_side_t side;
+  char text[RENDER_TEXT_SIZE];
+  uint32_t foreground;
+  uint32_t background;
+  /* Where, set by bar_layout() */
+  int16_t x;
+  uint16_t width;         /* 0 when empty or pushed off the end */
+  uint64_t fingerprint;   /* Of what it was last laid out with */
+  uint32_t generation;    /* Bumped with the fingerprint, to spot old images */
+  bool dirty;             /* Changed since it was last drawn */
+} bar_segment_t;
+typedef struct {
+  uint16_t width;
+  uint16_t height;
+  uint16_t scale;         /* Of the font */
+  uint16_t padding;       /* Either side of each segment's text */
+  uint32_t num_segments;
+  bar_segment_t segments[BAR_MAX_SEGMENTS];
+} bar_t;
+
+extern void bar_init(
+    bar_t *bar, uint16_t width, uint16_t height, uint16_t scale,
+    uint16_t padding
+);
+/* Segments are laid out in the order they're added. Returns the index */
+extern uint32_t bar_add(bar_t *bar, bar_side_t side);
+extern void bar_set(
+    bar_t *bar, uint32_t segment, const char *text, uint32_t foreground,
+    uint32_t background
+);
+/* Every segment is drawn again after, since what was drawn is gone */
+extern void bar_resize(bar_t *bar, uint16_t width);
+
+/* Places every segment, returning how many are dirty */
+extern uint32_t bar_layout(bar_t *bar);
+/* A job for a dirty segment, with the drawable, GC and tag left to fill in */
+extern void bar_job(const bar_t *bar, uint32_t segment, render_job_t *job);
+
+#endif /* BAR_H */
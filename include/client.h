@@ -0,0 +1,101 @@
+/* Include guard */
+#ifndef CLIENT_H
+#define CLIENT_H
+
+/* Includes */
+#include <stdint.h>
+#include <stdbool.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_icccm.h> /* For xcb_size_hints_t */
+#include <layout.h> /* For rect_t */
+#include <alloc.h>  /* For pool_t */
+
+/*
+ * ICCCM properties cached in the client, in the order they're fetched. Each is
+ * fetched once when the window is managed and again only after a
+ * PropertyNotify for its atom, so nothing reads them from the server
+ */
+typedef enum {
+  CLIENT_PROPERTY_NORMAL_HINTS,
+  CLIENT_PROPERTY_HINTS,
+  CLIENT_PROPERTY_CLASS,
+  CLIENT_PROPERTY_TRANSIENT_FOR,
+  CLIENT_PROPERTY_NET_NAME,
+  CLIENT_PROPERTY_NAME,
+  CLIENT_NUM_PROPERTIES
+} client_property_t;
+#define CLIENT_PROPERTIES_ALL ((1u << CLIENT_NUM_PROPERTIES) - 1)
+
+/* Client, a managed window. Records never move once allocated */
+typedef struct client {
+  xcb_window_t window;
+  xcb_window_t frame;   /* Parent drawn by the WM, 0 until reparented */
+  uint32_t id;          /* Stable index into the client pool */
+  uint32_t output;      /* Index into the WM's outputs */
+  uint32_t workspace;   /* Index into its output's workspaces */
+  bool mapped;
+  bool needs_map;       /* Mapped once its first layout has been sent */
+  bool hidden;          /* Unmapped by pwm, its workspace isn't shown */
+  bool unmap_pending;   /* An unmap of pwm's own hasn't been reported yet */
+  uint16_t unmap_sequence; /* Of the last unmap pwm sent */
+  bool floating;        /* Placed by hand rather than by the layout */
+  rect_t geometry;      /* Of the frame, as last reported by the server */
+  rect_t sent;          /* Of the frame, as last sent by the layout engine */
+  uint32_t border;      /* Border pixel the frame has */
+  bool decoration_dirty; /* Queued to have its decoration brought up to date */
+  struct client *next_dirty;
+  struct client *prev;  /* Layout order */
+  struct client *next;
+  struct client *focus_prev; /* Focus order, most recent first */
+  struct client *focus_next;
+  bool in_focus_order;
+  /* Cached properties, zeroed while unset */
+  xcb_size_hints_t size_hints;  /* WM_NORMAL_HINTS */
+  xcb_icccm_wm_hints_t hints;   /* WM_HINTS */
+  char *instance;               /* WM_CLASS, with the class in the same block */
+  const char *class_name;
+  xcb_window_t transient_for;   /* WM_TRANSIENT_FOR */
+  char *net_name;               /* _NET_WM_NAME */
+  char *name;                   /* WM_NAME */
+  bool properties_read;         /* Every property has been read once */
+  /* Property fetches, as bits of 1 << client_property_t */
+  uint8_t properties_pending;   /* Requested, replies not read yet */
+  uint8_t properties_stale;     /* Changed after being requested */
+  xcb_get_property_cookie_t property_cookies[CLIENT_NUM_PROPERTIES];
+  struct client *next_fetch;    /* Clients with properties pending */
+} client_t;
+
+/*
+ * List of clients, linked through the clients themselves. Layout order uses
+ * prev and next, focus order uses focus_prev and focus_next
+ */
+typedef struct {
+  client_t *head;
+  client_t *tail;
+  uint32_t count;
+} client_list_t;
+
+/* Client table */
+extern client_t *client_add(xcb_window_t window);
+/* Finds a client by its own window or its frame */
+extern client_t *client_find(xcb_window_t window);
+extern void client_set_frame(client_t *client, xcb_window_t frame);
+extern client_t *client_get(uint32_t id);
+/* Also frees its cached properties */
+extern void client_remove(client_t *client);
+extern uint32_t client_count(void);
+/* _NET_WM_NAME, or WM_NAME for clients without one, or NULL */
+extern const char *client_title(const client_t *client);
+extern const pool_t *client_pool(void); /* For its counters */
+extern void client_cleanup(void);
+
+/* Layout order */
+extern void client_list_append(client_list_t *list, client_t *client);
+extern void client_list_remove(client_list_t *list, client_t *client);
+
+/* Focus order */
+extern void client_focus_touch(client_list_t *list, client_t *client);
+extern void client_focus_append(client_list_t *list, client_t *client);
+extern void client_focus_remove(client_list_t *list, client_t *client);
+
+#endif /* CLIENT_H */
@@ -4,7 +4,42 @@
 
 /* Logging */
 #define LOGS 1      /* Enable logging */
+#define LOG_LEVEL 0 /* Lowest level compiled in (0 info, 1 warning, 2 error) */
 #define ANSI_LOGS 1 /* Enable formatted logs with ANSI escape codes */
+#define ASYNC_LOGS 1 /* Write logs from a background thread */
+#define LOG_BUFFER_SIZE 65536 /* Bytes queued for the writer (power of two) */
+
+/* Events */
+#define EVENT_BATCH_SIZE 64 /* Most events handled between flushes */
+#define IPC 1 /* Listen for commands on a control socket */
+#define STATS 0 /* Time event handlers, dumped on SIGUSR1 or over IPC */
+#define TRACE_RECORDS 65536 /* Events kept by PWM_TRACE (power of two) */
+#define RENDER_THREAD 1 /* Render text on a worker, off the event thread */
+#define SNAPSHOT 1 /* Keep where every window is in a file, to restart into */
+#define SNAPSHOT_INTERVAL 1000 /* Milliseconds from a change to writing it */
+
+/* Decorations */
+#define BORDER_WIDTH 2
+#define BORDER_FOCUSED 0x5f87afu
+#define BORDER_UNFOCUSED 0x303030u
+
+/* Bar */
+#define BAR 1 /* Along the top of every output, needs the render worker */
+#define BAR_HEIGHT 20
+#define BAR_SCALE 2 /* Pixels per pixel of the 5x7 font */
+#define BAR_PADDING 6 /* Either side of each segment's text */
+#define BAR_FOREGROUND 0xd0d0d0u
+#define BAR_BACKGROUND 0x1c1c1cu
+#define BAR_EMPTY 0x6c6c6cu /* Workspaces without clients */
+#define BAR_SELECTED BORDER_FOCUSED /* The workspace being shown */
+#define BAR_CLOCK_FORMAT "%a %d %b %H:%M" /* For strftime() */
+#define BAR_CLOCK_INTERVAL 60 /* Seconds between ticks, on the wall clock */
+#define BAR_BLOCKS 8 /* Set with "bar <name> <text>" on the control socket */
+
+/* Workspaces */
+#define WORKSPACES 9 /* Per output */
+#define DEFAULT_LAYOUT LAYOUT_TILE /* Any of the LAYOUTS in layout.h */
+#define TILED_SIZE_HINTS 1 /* Tiled clients keep to their size hints too */
 
 /* Keymaps - keys*/
 #define SHIFT XCB_MOD_MASK_SHIFT
@@ -15,14 +50,46 @@
 #define MOD3 XCB_MOD_MASK_3
 #define MOD4 XCB_MOD_MASK_4
 #define MOD5 XCB_MOD_MASK_5
+/* Pointer, held modifiers and button to drag a window with */
+#define DRAG_MODIFIERS MOD1
+#define MOVE_BUTTON 1
+#define RESIZE_BUTTON 3
 /* Keymaps - commands */
 static const char *termcmd[] = { "st", (void *)(0) };
 static const char *dmenucmd[] = { "dmenu_run", (void *)(0) };
 /* Keymaps */
 #define KEYMAPS \
     { MOD1|SHIFT, XKB_KEY_c, handle_keymap_quit, { .i32 = 0 } },\
+    { MOD1|SHIFT, XKB_KEY_r, handle_keymap_restart, { .i32 = 0 } },\
     { MOD1|SHIFT, XKB_KEY_q, handle_keymap_destroy, { .i32 = 0 } },\
     { MOD1, XKB_KEY_Return, handle_keymap_spawnprocess, { .ptr = termcmd } },\
-    { MOD1, XKB_KEY_d, handle_keymap_spawnprocess, { .ptr = dmenucmd } },
+    { MOD1, XKB_KEY_d, handle_keymap_spawnprocess, { .ptr = dmenucmd } },\
+    { MOD1, XKB_KEY_Tab, handle_keymap_cycle, { .i32 = 1 } },\
+    { MOD1|SHIFT, XKB_KEY_Tab, handle_keymap_cycle, { .i32 = -1 } },\
+    { MOD1, XKB_KEY_t, handle_keymap_layout, { .i32 = LAYOUT_TILE } },\
+    { MOD1, XKB_KEY_m, handle_keymap_layout, { .i32 = LAYOUT_MONOCLE } },\
+    { MOD1, XKB_KEY_g, handle_keymap_layout, { .i32 = LAYOUT_GRID } },\
+    { MOD1, XKB_KEY_c, handle_keymap_layout, { .i32 = LAYOUT_COLUMNS } },\
+    WORKSPACE_KEYMAPS(XKB_KEY_1, 1)\
+    WORKSPACE_KEYMAPS(XKB_KEY_2, 2)\
+    WORKSPACE_KEYMAPS(XKB_KEY_3, 3)\
+    WORKSPACE_KEYMAPS(XKB_KEY_4, 4)\
+    WORKSPACE_KEYMAPS(XKB_KEY_5, 5)\
+    WORKSPACE_KEYMAPS(XKB_KEY_6, 6)\
+    WORKSPACE_KEYMAPS(XKB_KEY_7, 7)\
+    WORKSPACE_KEYMAPS(XKB_KEY_8, 8)\
+    WORKSPACE_KEYMAPS(XKB_KEY_9, 9)
+/* Keymaps - workspaces, numbered from 1 */
+#define WORKSPACE_KEYMAPS(keysym, workspace)\
+    { MOD1, keysym, handle_keymap_view, { .i32 = workspace } },\
+    { MOD1|SHIFT, keysym, handle_keymap_send, { .i32 = workspace } },
+/*
+ * Rules - class, instance and title (NULL for any, * and ? glob), then
+ * floating (1 floats, 0 tiles, -1 leaves it), workspace and output (from 1,
+ * 0 leaves it). Later matches override earlier ones
+ */
+#define RULES \
+    { { NULL, NULL, "Picture-in-Picture" }, 1, 0, 0 },\
+    { { "Gimp", NULL, "*Preferences*" }, 1, 0, 0 },
 
 #endif /* CONFIG_H */
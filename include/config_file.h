@@ -0,0 +1,71 @@
+/* Include guard */
+#ifndef CONFIG_FILE_H
+#define CONFIG_FILE_H
+
+/* Includes */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <xkbcommon/xkbcommon.h>
+#include <rules.h> /* For rule_t */
+
+/*
+ * Runtime configuration. The file holds one binding or rule per line, with #
+ * starting a comment:
+ *
+ *   bind Mod1+Shift+c quit
+ *   bind Mod1+Return spawn st -e "tmux new"
+ *   bind Mod1+Shift+Tab cycle -1
+ *   rule class Firefox workspace 2
+ *   rule class Gimp title "*Preferences*" floating output 2
+ *
+ * A rule matches on any of class, instance and title, each a string or a
+ * glob (see rules.h), and does any of floating, tiled, workspace <n> and
+ * output <n>. Commands, and what argument each takes, are supplied by the
+ * caller, and bindings refer to them by index. Everything a file produces
+ * lives in one config_t, freed in one go
+ */
+typedef enum {
+  CONFIG_ARG_NONE,
+  CONFIG_ARG_INT,
+  CONFIG_ARG_ARGV /* The rest of the line, split into words */
+} config_arg_t;
+typedef struct {
+  const char *name;
+  config_arg_t arg;
+  /* Words a CONFIG_ARG_INT can be given instead, standing for their index */
+  const char *const *values;
+  uint32_t num_values;
+} config_command_t;
+typedef struct {
+  uint16_t modifiers;
+  xkb_keysym_t keysym;
+  uint32_t command;
+  union {
+    int32_t i32;
+    char **argv; /* NULL-terminated */
+  } arg;
+} config_binding_t;
+typedef struct {
+  config_binding_t *bindings;
+  uint32_t num_bindings;
+  rule_t *rules; /* Patterns point into text */
+  uint32_t num_rules;
+  char *text;  /* The file, with words terminated in place */
+  char **words; /* Every argv, back to back */
+} config_t;
+
+/* Path of the config file, from PWM_CONFIG, XDG_CONFIG_HOME or HOME */
+extern void config_file_path(char *path, size_t size);
+
+/*
+ * Parse a file. Returns false, logging where, if it can't be read or has any
+ * mistakes, so a broken edit never replaces a working configuration
+ */
+extern bool config_file_load(
+    const char *path, const config_command_t *commands, uint32_t num_commands,
+    config_t *config
+);
+extern void config_file_free(config_t *config);
+
+#endif /* CONFIG_FILE_H */
@@ -0,0 +1,110 @@
+/* Include guard */
+#ifndef IPC_H
+#define IPC_H
+
+/* Includes */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <alloc.h> /* For pool_t */
+
+/*
+ * Control socket protocol
+ *
+ * Connections start in text mode: one command per line, with arguments
+ * separated by spaces, e.g. "move 0x400001 0 0 640 480". A connection that
+ * starts with the 4 bytes of IPC_MAGIC switches to binary mode, where every
+ * message is a frame: a uint32_t payload length followed by the payload, all
+ * in host byte order. A request payload is a uint8_t op, numbered as below,
+ * followed by its arguments:
+ *
+ *    0 quit
+ *    1 destroy   uint32_t window (0 for the focused window)
+ *    2 spawn     argv strings, each NUL-terminated
+ *    3 move      uint32_t window, int32_t x, y, width, height (x and y
+ *                within int16_t, sizes from 1 to UINT16_MAX)
+ *    4 tile      uint32_t window
+ *    5 clients
+ *    6 subscribe uint32_t event mask (IPC_EVENT_*)
+ *    7 (event, only sent by the WM)
+ *    8 stats
+ *    9 reload
+ *   10 view      uint32_t workspace (from 1, on the focused window's output)
+ *   11 send      uint32_t window, uint32_t workspace
+ *   12 bar       block name, then its text, each NUL-terminated (no text
+ *                clears it)
+ *   13 restart
+ *
+ * Every command read in one pass of the event loop is applied before the
+ * loop's single flush, so a batch costs one round trip to the X server.
+ * Replies and events are framed the same way, starting with the op they
+ * answer (or IPC_OP_EVENT), and are lines of text in text mode
+ */
+#define IPC_MAGIC "\0pwm"
+#define IPC_MAX_ARGS 32
+
+/* Ops, pinned since they're on the wire. New ones only go on the end */
+typedef enum {
+  IPC_OP_QUIT = 0,
+  IPC_OP_DESTROY = 1,
+  IPC_OP_SPAWN = 2,
+  IPC_OP_MOVE = 3,
+  IPC_OP_TILE = 4,
+  IPC_OP_CLIENTS = 5,
+  IPC_OP_SUBSCRIBE = 6,
+  IPC_OP_EVENT = 7, /* Only sent by the WM */
+  IPC_OP_STATS = 8,
+  IPC_OP_RELOAD = 9,
+  IPC_OP_VIEW = 10,
+  IPC_OP_SEND = 11,
+  IPC_OP_BAR = 12,
+  IPC_OP_RESTART = 13,
+  NUM_IPC_OPS
+} ipc_op_t;
+
+/* Events that can be subscribed to */
+typedef enum {
+  IPC_EVENT_MAP = 1 << 0,
+  IPC_EVENT_UNMAP = 1 << 1,
+  IPC_EVENT_FOCUS = 1 << 2
+} ipc_event_t;
+
+/* A decoded command, whichever mode it came in */
+typedef struct {
+  ipc_op_t op;
+  uint32_t window;
+  int32_t values[4];
+  uint32_t argc;
+  char *argv[IPC_MAX_ARGS + 1]; /* NULL-terminated, valid during the call */
+} ipc_command_t;
+
+/* A connected client */
+typedef struct ipc_client ipc_client_t;
+typedef void (*ipc_handler_t)(ipc_client_t *client, const ipc_command_t *command);
+
+/* Default socket path, from PWM_SOCKET or else XDG_RUNTIME_DIR and DISPLAY */
+extern void ipc_socket_path(char *path, size_t size);
+
+/* Listen on a socket, handing every command read to handler */
+extern bool ipc_init(const char *path, ipc_handler_t handler);
+extern void ipc_cleanup(void);
+/* Where client records come from, for its counters */
+extern const pool_t *ipc_client_pool(void);
+
+/* Replying */
+extern bool ipc_binary(const ipc_client_t *client);
+/* False when the client was dropped, it's gone and mustn't be used again */
+extern bool ipc_reply(ipc_client_t *client, const void *data, uint32_t length);
+
+/*
+ * Send an event to every subscriber, as a binary payload or a line of text
+ * depending on each subscriber's mode
+ */
+extern void ipc_publish(
+    ipc_event_t event, const void *data, uint32_t length, const char *text
+);
+
+/* Send everything queued by replies and events, once per loop iteration */
+extern void ipc_flush(void);
+
+#endif /* IPC_H */
@@ -0,0 +1,24 @@
+/* Include guard */
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+/* Includes */
+#include <sys/types.h> /* For pid_t */
+
+/* Reap any children left over from before an exec */
+extern void launcher_init(void);
+
+/*
+ * Start a program (searched for in PATH) with stdout and stderr sent to
+ * /dev/null, returning its pid or -1. This uses posix_spawn(), which doesn't
+ * copy the WM's page tables the way fork() does
+ */
+extern pid_t launcher_spawn(char *const argv[]);
+
+/*
+ * Reap every child that has exited, without blocking. The WM calls this on
+ * SIGCHLD, so children never pile up as zombies
+ */
+extern void launcher_reap(void);
+
+#endif /* LAUNCHER_H */
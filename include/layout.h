@@ -0,0 +1,59 @@
+/* Include guard */
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+/* Includes */
+#include <stdint.h>
+
+/* Rectangle */
+typedef struct {
+  int16_t x;
+  int16_t y;
+  uint16_t width;
+  uint16_t height;
+} rect_t;
+
+/* Rectangle comparison */
+extern int rect_equal(rect_t a, rect_t b);
+
+/*
+ * Layouts. Each fills one rectangle per window into a caller's array and
+ * never allocates. Adding one is a line here and a layout_<ident>() function:
+ * layout_apply() is a switch generated from this list, so the relayout path
+ * calls each layout directly rather than through a pointer
+ */
+#define LAYOUTS\
+  LAYOUT(TILE, tile)\
+  LAYOUT(MONOCLE, monocle)\
+  LAYOUT(GRID, grid)\
+  LAYOUT(COLUMNS, columns)
+typedef enum {
+#define LAYOUT(name, ident) LAYOUT_##name,
+  LAYOUTS
+#undef LAYOUT
+  NUM_LAYOUTS
+} layout_t;
+extern const char *const LAYOUT_NAMES[NUM_LAYOUTS];
+
+/* Lay out num_windows windows in area with the given layout */
+extern void layout_apply(
+    layout_t layout, rect_t area, uint32_t num_windows, rect_t *rects
+);
+
+/*
+ * Master/stack tiling. The first window takes the left half of the area and
+ * the rest split the right half evenly, or the first window takes all of it
+ * when it's alone
+ */
+extern void layout_tile(rect_t area, uint32_t num_windows, rect_t *rects);
+/* Every window takes the whole area */
+extern void layout_monocle(rect_t area, uint32_t num_windows, rect_t *rects);
+/*
+ * Rows of equal cells, with as many columns as the smallest square that fits
+ * every window. The last row's windows share its width between them
+ */
+extern void layout_grid(rect_t area, uint32_t num_windows, rect_t *rects);
+/* Windows side by side, each the full height and an equal share of width */
+extern void layout_columns(rect_t area, uint32_t num_windows, rect_t *rects);
+
+#endif /* LAYOUT_H */
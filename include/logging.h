@@ -12,9 +12,37 @@ typedef enum {
   LOG_LEVEL_ERROR
 } log_level_t;
 
+/* Messages below this level are skipped before they're formatted */
+extern log_level_t log_level;
+
+/*
+ * Read the runtime level from PWM_LOG_LEVEL and start the background writer
+ * (when ASYNC_LOGS is set)
+ */
+extern void log_init(void);
+/* Write out anything still queued and stop the background writer */
+extern void log_cleanup(void);
 
 /* Log to stdout */
 extern void log_msg(log_level_t level, const char *format, ...)
     __attribute__((format(printf, 2, 3)));
 
+/*
+ * Per-level logging macros. Levels below LOG_LEVEL compile to nothing, so
+ * their arguments aren't even evaluated. Errors abort, so they always stay
+ */
+#if LOGS && LOG_LEVEL <= 0
+#define LOG_INFO(...) (log_level <= LOG_LEVEL_INFO\
+    ? log_msg(LOG_LEVEL_INFO, __VA_ARGS__) : (void)0)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+#if LOGS && LOG_LEVEL <= 1
+#define LOG_WARNING(...) (log_level <= LOG_LEVEL_WARNING\
+    ? log_msg(LOG_LEVEL_WARNING, __VA_ARGS__) : (void)0)
+#else
+#define LOG_WARNING(...) ((void)0)
+#endif
+#define LOG_ERROR(...) log_msg(LOG_LEVEL_ERROR, __VA_ARGS__)
+
 #endif /* LOGGING_H */
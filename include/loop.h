@@ -0,0 +1,34 @@
+/* Include guard */
+#ifndef LOOP_H
+#define LOOP_H
+
+/* Includes */
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/epoll.h> /* For EPOLLIN, etc */
+
+/* Called with a ready file descriptor and its epoll events */
+typedef void (*loop_handler_t)(int fd, uint32_t events, void *data);
+
+/* Set up and tear down the epoll instance */
+extern void loop_init(void);
+extern void loop_cleanup(void);
+
+/* Start, change and stop watching a file descriptor */
+extern bool loop_watch(int fd, uint32_t events, loop_handler_t handler, void *data);
+extern void loop_modify(int fd, uint32_t events);
+extern void loop_unwatch(int fd);
+
+/*
+ * Timers, backed by a timerfd each. The expiry count is read before the
+ * handler runs, so handlers don't need to read the file descriptor themselves
+ */
+extern int loop_timer_add(loop_handler_t handler, void *data);
+extern void loop_timer_arm(int timer, uint64_t delay_ns, uint64_t interval_ns);
+extern void loop_timer_disarm(int timer);
+extern void loop_timer_remove(int timer);
+
+/* Wait up to timeout milliseconds (-1 for ever) and run ready handlers */
+extern void loop_wait(int timeout);
+
+#endif /* LOOP_H */
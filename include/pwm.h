@@ -5,19 +5,42 @@
 /* Includes */
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/signalfd.h>
+#include <sys/inotify.h>
+#include <limits.h>
 #include <xcb/xcb.h>
 #include <xcb/xcb_icccm.h>
+#include <xcb/xkb.h>
+#include <xcb/randr.h>
 #include <xkbcommon/xkbcommon.h>
+#include <xkbcommon/xkbcommon-x11.h>
 #include <config.h>
 #include <logging.h>
+#include <client.h>
+#include <launcher.h>
+#include <loop.h>
+#include <ipc.h>
+#include <stats.h>
+#include <trace.h>
+#include <replay.h>
+#include <config_file.h>
+#include <alloc.h>
+#include <rules.h>
+#include <render.h>
+#include <bar.h>
+#include <snapshot.h>
 
 /* Global state */
 static bool running = false;
+static int signal_fd = -1;
 static xcb_connection_t *connection = NULL;
 static const xcb_setup_t *setup = NULL;
 static xcb_screen_t *screen = NULL;
@@ -25,8 +48,96 @@ static xcb_window_t root = 0;
 static struct xkb_context *xkb_context = NULL;
 static struct xkb_keymap *xkb_keymap = NULL;
 static struct xkb_state *xkb_state = NULL;
-static xcb_atom_t WM_PROTOCOLS = 0;
-static xcb_atom_t WM_DELETE_WINDOW = 0;
+static int32_t xkb_device = -1;
+static uint8_t xkb_event_base = 0;
+static bool xkb_keymap_outdated = false;
+static char config_path[PATH_MAX];
+static int config_watch_fd = -1; /* inotify on the config file's directory */
+static bool config_outdated = false;
+static client_t *focused = NULL; /* As last reported by the server */
+static client_t *focus_target = NULL; /* Where focus is being sent */
+static bool focus_outdated = false;
+static client_list_t focus_order = { 0 }; /* Mapped clients, by recency */
+static bool cycling = false; /* Keyboard grabbed to cycle through focus */
+static client_t *cycle_candidate = NULL;
+static uint16_t cycle_modifiers = 0; /* Letting go of any of these commits */
+static uint8_t modifier_keys[256]; /* Modifiers each keycode sets */
+static client_t *dirty_decorations = NULL; /* Linked through next_dirty */
+static bool layout_dirty = false; /* Set when any output is dirty */
+/* Scratch space for one pass of the event loop, reset by finish_loop_pass() */
+#define PASS_ARENA_SIZE 65536
+static arena_t pass_arena = { 0 };
+
+/* Outputs, one per distinct active CRTC */
+#define MAX_OUTPUTS 16
+/*
+ * Each output shows one of its workspaces. Switching only records which, and
+ * the next pass unmaps the old one's clients and maps the new one's in one go.
+ * Hidden workspaces keep their dirty flag until they're shown, so they're
+ * never laid out while nobody can see them
+ */
+typedef struct {
+  client_list_t clients;  /* Mapped clients in layout order */
+  layout_t layout;
+  bool dirty;             /* Needs laying out */
+} workspace_t;
+#define DEFAULT_FRAME_NS (1000000000ull/60) /* When RandR can't say */
+typedef struct {
+  xcb_randr_crtc_t crtc;  /* 0 when RandR isn't available */
+  rect_t area;
+  uint64_t frame_ns;      /* Refresh interval of its mode */
+  workspace_t workspaces[WORKSPACES];
+  uint32_t workspace;     /* The one being shown */
+  uint32_t shown;         /* The one whose clients are mapped */
+  xcb_window_t bar_window; /* 0 without a bar */
+  xcb_pixmap_t bar_pixmap; /* What it shows, drawn a segment at a time */
+  bar_t bar;
+} output_t;
+static output_t outputs[MAX_OUTPUTS];
+static uint32_t num_outputs = 0;
+static uint32_t current_output = 0; /* Where new clients go */
+static uint8_t randr_event_base = 0;
+static bool outputs_outdated = false;
+static bool workspaces_outdated = false; /* An output's shown one changed */
+
+/* Atoms, all interned together by get_atoms() */
+#define ATOMS\
+  ATOM(UTF8_STRING)\
+  ATOM(WM_PROTOCOLS)\
+  ATOM(WM_DELETE_WINDOW)\
+  ATOM(WM_TAKE_FOCUS)\
+  ATOM(WM_STATE)\
+  ATOM(WM_CHANGE_STATE)\
+  ATOM(_NET_SUPPORTED)\
+  ATOM(_NET_SUPPORTING_WM_CHECK)\
+  ATOM(_NET_WM_NAME)\
+  ATOM(_NET_CLIENT_LIST)\
+  ATOM(_NET_CLIENT_LIST_STACKING)\
+  ATOM(_NET_ACTIVE_WINDOW)\
+  ATOM(_NET_CLOSE_WINDOW)\
+  ATOM(_NET_NUMBER_OF_DESKTOPS)\
+  ATOM(_NET_CURRENT_DESKTOP)\
+  ATOM(_NET_DESKTOP_NAMES)\
+  ATOM(_NET_WM_DESKTOP)\
+  ATOM(_NET_WM_STATE)\
+  ATOM(_NET_WM_STATE_FULLSCREEN)\
+  ATOM(_NET_WM_STATE_DEMANDS_ATTENTION)\
+  ATOM(_NET_WM_WINDOW_TYPE)\
+  ATOM(_NET_WM_WINDOW_TYPE_DIALOG)\
+  ATOM(_NET_WM_WINDOW_TYPE_DOCK)\
+  ATOM(_PWM_SNAPSHOT)
+#define ATOM(name) static xcb_atom_t name = 0;
+ATOMS
+#undef ATOM
+static const struct {
+  const char *name;
+  xcb_atom_t *atom;
+} ATOM_TABLE[] = {
+#define ATOM(name) { #name, &name },
+  ATOMS
+#undef ATOM
+};
+#define NUM_ATOMS (sizeof(ATOM_TABLE)/sizeof(ATOM_TABLE[0]))
 
 /* Setup */
 static xcb_connection_t *get_connection(void);
@@ -34,24 +145,243 @@ static void disconnect(void);
 static const xcb_setup_t *get_setup(void);
 static xcb_screen_t *get_screen(void);
 static xcb_window_t get_root(void);
-static xcb_atom_t get_atom(const char *name);
+static void get_atoms(void);
 static void log_setup_info(void);
+static void setup_randr(void);
+static void update_outputs(void);
+static uint64_t get_frame_ns(
+    const xcb_randr_mode_info_t *modes, int num_modes, xcb_randr_mode_t mode
+);
+static uint32_t add_output(xcb_randr_crtc_t crtc, rect_t area);
+static void remove_output(uint32_t index);
+static uint32_t find_output(int16_t x, int16_t y);
+static void adopt_windows(void);
+static void adopt_children(const xcb_window_t *children, int num_children);
 static void eventloop(void);
+static void finish_loop_pass(void);
+static void setup_trace(void);
+static int replay(const char *path);
+static void setup_signals(void);
+static void handle_connection_fd(int fd, uint32_t events, void *data);
+static void handle_signal_fd(int fd, uint32_t events, void *data);
+static void handle_config_watch_fd(int fd, uint32_t events, void *data);
+
+/* Event batching */
+static void handle_xcb_events(xcb_generic_event_t *first);
+static void handle_event_batch(
+    xcb_generic_event_t **events, uint32_t num_events
+);
+static void dispatch_event(xcb_generic_event_t *event);
+static void coalesce_events(xcb_generic_event_t **events, uint32_t num_events);
+static void merge_configure_requests(
+    const xcb_configure_request_event_t *older,
+    xcb_configure_request_event_t *newer
+);
 
 /* Manipulating windows */
+static client_t *manage_window(xcb_window_t window);
+static void release_client(client_t *client);
+static void unmanage_client(client_t *client);
+static void attach_client(client_t *client, uint32_t output);
+static void detach_client(client_t *client);
+static void arrange(void);
+static void send_client_rect(client_t *client, rect_t rect);
+static void send_configure_notify(client_t *client);
+static uint16_t strip_border(uint16_t size);
+static void mark_workspace(uint32_t output, uint32_t workspace);
+static bool client_visible(const client_t *client);
+static void sync_client_visibility(client_t *client);
+static void view_workspace(uint32_t output, uint32_t workspace);
+static void send_to_workspace(client_t *client, uint32_t workspace);
+static void move_client(client_t *client, uint32_t output, uint32_t workspace);
+static void update_workspaces(void);
+static client_t *recent_visible_client(void);
+static void focus_client(client_t *client);
+static void update_focus(void);
+static void end_cycle(void);
+static void mark_decoration(client_t *client);
+static void update_decorations(void);
 static void set_event_mask(xcb_window_t window, uint32_t event_mask);
 static void set_window_rect(
     xcb_window_t window, uint16_t x, uint16_t y, uint16_t width, uint16_t height
 );
 
+/* Client properties */
+/*
+ * Properties are requested when a window is managed or a PropertyNotify says
+ * one changed, and whatever's outstanding is read in one go before the
+ * layout, so a pass costs at most one round trip however many windows came.
+ * The layout only ever reads the copies in the client
+ */
+static client_t *fetching_clients = NULL; /* Linked through next_fetch */
+#define PROPERTY_TEXT_LENGTH 256 /* Most of a title read, in 4 byte units */
+static void request_properties(client_t *client, uint8_t properties);
+static void read_properties(void);
+static void read_property(client_t *client, client_property_t property);
+static char *copy_property_text(xcb_get_property_reply_t *reply);
+static void discard_properties(client_t *client);
+static client_property_t find_client_property(xcb_atom_t atom);
+static rect_t apply_size_hints(const client_t *client, rect_t rect);
+static rect_t place_floating(const client_t *client);
+
+/* Rules */
+/*
+ * Compiled from the config file's rules, or the compiled in ones without it.
+ * They're applied when a new window's properties are read, which is in the
+ * same pass as its map request and before its first configure or map
+ */
+const rule_t _RULES[] = { RULES };
+#define NUM_RULES (sizeof(_RULES)/sizeof(rule_t))
+static rules_t *rules = NULL;
+static rules_t *compile_rules(const config_t *config);
+static void apply_rules(client_t *client);
+
+/* Pointer drags */
+/*
+ * However fast the pointer reports motion, only its latest position is kept,
+ * and the window is configured at most once per refresh of its output: after
+ * each configure the timer has to run out before the next one goes
+ */
+typedef enum { DRAG_NONE, DRAG_MOVE, DRAG_RESIZE } drag_mode_t;
+typedef struct {
+  drag_mode_t mode;
+  client_t *client;
+  xcb_button_t button;
+  int16_t start_x;    /* Of the pointer, when the drag started */
+  int16_t start_y;
+  rect_t start;       /* Of the client, when the drag started */
+  int16_t x;          /* Of the pointer, latest */
+  int16_t y;
+  bool pending;       /* The pointer moved since the last configure */
+  bool paced;         /* Waiting for the frame after the last configure */
+} drag_t;
+static drag_t drag = { 0 };
+static int drag_timer = -1;
+static void setup_drag(void);
+static void begin_drag(
+    client_t *client, drag_mode_t mode, const xcb_button_press_event_t *event
+);
+static void update_drag(void);
+static void end_drag(void);
+static void handle_drag_timer(int fd, uint32_t events, void *data);
+
+/* Rendering */
+/*
+ * Text is laid out and drawn into images by the render worker, and the images
+ * are sent from here, so only the event thread uses the connection
+ */
+static int render_fd = -1;
+static uint32_t put_image_max = 0; /* Bytes of pixels one PutImage can hold */
+static void setup_render(void);
+static void handle_render_fd(int fd, uint32_t events, void *data);
+static void put_render_image(const render_image_t *image);
+
+/* Bar */
+/*
+ * Segments are set from scratch whenever anything they show may have changed,
+ * once a pass, and only those whose fingerprint changed are drawn again. Each
+ * one drawn is put into the output's pixmap and copied to the window as a
+ * single rectangle, and exposures are copied from the pixmap without drawing
+ * anything. Nothing wakes the loop for the bar but the clock
+ */
+#define BAR_SEGMENT_TITLE WORKSPACES
+#define BAR_SEGMENT_BLOCKS (BAR_SEGMENT_TITLE + 1)
+#define BAR_SEGMENT_CLOCK (BAR_SEGMENT_BLOCKS + BAR_BLOCKS)
+_Static_assert(
+    BAR_SEGMENT_CLOCK < BAR_MAX_SEGMENTS, "Too many bar segments"
+);
+#define BAR_BLOCK_NAME_SIZE 32
+typedef struct {
+  char name[BAR_BLOCK_NAME_SIZE]; /* Empty for a free block */
+  char text[RENDER_TEXT_SIZE];
+} bar_block_t;
+static bar_block_t bar_blocks[BAR_BLOCKS];
+static char bar_clock[64] = { 0 };
+static int bar_timer = -1;
+static xcb_gcontext_t bar_gc = 0;
+static bool bar_outdated = false;
+static void setup_bar(void);
+static void update_output_bars(void);
+static void create_bar(uint32_t output);
+static void create_bar_pixmap(uint32_t output);
+static void destroy_bar(uint32_t output);
+static void mark_bar(void);
+static void update_bar(void);
+static void draw_bar(uint32_t output);
+static void show_bar_image(const render_image_t *image);
+static void set_bar_block(const char *name, char *const words[]);
+static void tick_bar_clock(void);
+static void handle_bar_timer(int fd, uint32_t events, void *data);
+static rect_t work_area(uint32_t output);
+
+/* Snapshot */
+/*
+ * A change arms a timer rather than being written straight away, so a burst
+ * of them is one update, and nothing wakes the loop while nothing changes.
+ * Restarting keeps the frames, which the next pwm finds in the snapshot
+ */
+_Static_assert(
+    MAX_OUTPUTS <= SNAPSHOT_OUTPUTS, "Snapshots can't hold every output"
+);
+static int snapshot_timer = -1;
+static bool snapshot_pending = false;
+static bool restarting = false; /* Exec pwm again once the loop ends */
+static bool restore_snapshot(void);
+static uint32_t restore_output(const snapshot_t *snapshot, uint32_t index);
+static int compare_snapshot_clients(const void *a, const void *b);
+static int compare_snapshot_focus(const void *a, const void *b);
+static int compare_windows(const void *a, const void *b);
+static void setup_snapshot(void);
+static void mark_snapshot(void);
+static void update_snapshot(void);
+static void handle_snapshot_timer(int fd, uint32_t events, void *data);
+static void keep_frames(void);
+
+/* EWMH */
+/*
+ * What pwm last wrote to a root property. Handlers only change the live copy
+ * and set ewmh_outdated, and once per loop pass each property is compared
+ * against its shadow, so a pass writes each one at most once, and not at all
+ * when it ends up where it started
+ */
+typedef struct {
+  uint32_t *values;
+  uint32_t length;
+  uint32_t capacity;
+  bool written; /* Whatever was there before pwm is always overwritten */
+} ewmh_shadow_t;
+static xcb_window_t ewmh_check_window = XCB_NONE;
+static bool ewmh_outdated = false;
+static xcb_window_t *ewmh_clients = NULL; /* Live client list, by map order */
+static uint32_t num_ewmh_clients = 0;
+static uint32_t ewmh_clients_capacity = 0;
+static ewmh_shadow_t ewmh_client_list_shadow = { 0 };
+static ewmh_shadow_t ewmh_active_window_shadow = { 0 };
+static void setup_ewmh(void);
+static void update_ewmh(void);
+static void cleanup_ewmh(void);
+static void list_ewmh_client(const client_t *client);
+static void unlist_ewmh_client(const client_t *client);
+static void publish_root_property(
+    xcb_atom_t property, xcb_atom_t type, ewmh_shadow_t *shadow,
+    const uint32_t *values, uint32_t length
+);
+
 /* Keyboard */
 static struct xkb_context *create_xkb_context(void);
+static void setup_xkb_extension(void);
+static void select_xkb_events(void);
+static void update_xkb_keymap(void);
 static struct xkb_keymap *create_xkb_keymap(void);
 static struct xkb_state *create_xkb_state(void);
 static void unref_xkb_context(void);
 static void unref_xkb_keymap(void);
 static void unref_xkb_state(void);
-static void grab_keymap(uint16_t modifiers, xkb_keysym_t keysym);
+static void update_modifier_keys(void);
+static xcb_void_cookie_t grab_keymap(
+    uint16_t modifiers, xkb_keysym_t keysym, xkb_keycode_t keycode,
+    bool checked
+);
 
 /* Keymap data */
 typedef union {
@@ -70,22 +400,130 @@ typedef struct {
 static void handle_keymap_quit(
     xcb_key_press_event_t *event, keymap_data_t data
 );
+static void handle_keymap_restart(
+    xcb_key_press_event_t *event, keymap_data_t data
+);
 static void handle_keymap_destroy(
     xcb_key_press_event_t *event, keymap_data_t data
 );
 static void handle_keymap_spawnprocess(
     xcb_key_press_event_t *event, keymap_data_t data
 );
-/* Keymaps */
+static void handle_keymap_move(
+    xcb_key_press_event_t *event, keymap_data_t data
+);
+static void handle_keymap_tile(
+    xcb_key_press_event_t *event, keymap_data_t data
+);
+static void handle_keymap_cycle(
+    xcb_key_press_event_t *event, keymap_data_t data
+);
+static void handle_keymap_view(
+    xcb_key_press_event_t *event, keymap_data_t data
+);
+static void handle_keymap_send(
+    xcb_key_press_event_t *event, keymap_data_t data
+);
+static void handle_keymap_layout(
+    xcb_key_press_event_t *event, keymap_data_t data
+);
+static client_t *keymap_target(const xcb_key_press_event_t *event);
+/* Keymaps, the compiled in ones until a config file replaces them */
 const keymap_t _KEYMAPS[] = { KEYMAPS };
 #define NUM_KEYMAPS (sizeof(_KEYMAPS)/sizeof(keymap_t))
+static const keymap_t *keymaps = _KEYMAPS;
+static uint32_t num_keymaps = NUM_KEYMAPS;
+/*
+ * Keymap lookup, filled by apply_keymaps(). A new table is built in the spare
+ * one and swapped in whole, so a key press never sees half of a reload
+ */
+#define KEYMAP_MODIFIERS 0xff /* Modifier bits that are part of a keymap */
+typedef uint16_t keymap_table_t[256][KEYMAP_MODIFIERS + 1]; /* Index + 1 */
+static keymap_table_t keymap_tables[2];
+static uint16_t (*keymap_lookup)[KEYMAP_MODIFIERS + 1] = keymap_tables[0];
+static xkb_keycode_t *keymap_keycodes = NULL; /* One per keymap */
+static void resolve_keymaps(
+    const keymap_t *keymaps, uint32_t num_keymaps, xkb_keycode_t *keycodes
+);
+static void apply_keymaps(
+    const keymap_t *keymaps, uint32_t num_keymaps, bool checked
+);
+static int compare_keymap_keysyms(const void *a, const void *b);
+static const keymap_t *sorting_keymaps = NULL; /* For qsort() */
+
+/* Runtime config */
+static void setup_config(void);
+static void reload_config(void);
+static keymap_t *compile_config(const config_t *config);
+static void cleanup_config(void);
+/* Commands a config file can bind, with the argument each takes */
+#define CONFIG_COMMANDS\
+  COMMAND(quit, NONE, handle_keymap_quit, NULL, 0)\
+  COMMAND(restart, NONE, handle_keymap_restart, NULL, 0)\
+  COMMAND(destroy, NONE, handle_keymap_destroy, NULL, 0)\
+  COMMAND(spawn, ARGV, handle_keymap_spawnprocess, NULL, 0)\
+  COMMAND(tile, NONE, handle_keymap_tile, NULL, 0)\
+  COMMAND(cycle, INT, handle_keymap_cycle, NULL, 0)\
+  COMMAND(view, INT, handle_keymap_view, NULL, 0)\
+  COMMAND(send, INT, handle_keymap_send, NULL, 0)\
+  COMMAND(layout, INT, handle_keymap_layout, LAYOUT_NAMES, NUM_LAYOUTS)
+#define COMMAND(name, arg, handler, values, num_values)\
+  { #name, CONFIG_ARG_##arg, values, num_values },
+static const config_command_t CONFIG_COMMAND_NAMES[] = { CONFIG_COMMANDS };
+#undef COMMAND
+#define COMMAND(name, arg, handler, values, num_values) handler,
+static void (*const CONFIG_HANDLERS[])(
+    xcb_key_press_event_t *event, keymap_data_t data
+) = { CONFIG_COMMANDS };
+#undef COMMAND
+#define NUM_CONFIG_COMMANDS\
+  (sizeof(CONFIG_COMMAND_NAMES)/sizeof(CONFIG_COMMAND_NAMES[0]))
+/* The loaded file and the keymaps compiled from it, NULL for the defaults */
+static config_t config = { 0 };
+static keymap_t *config_keymaps = NULL;
+
+/* IPC */
+#define IPC_CLIENT_LINE_SIZE 64 /* Room for a clients line, or binary record */
+static void setup_ipc(void);
+static void handle_ipc_command(
+    ipc_client_t *client, const ipc_command_t *command
+);
+static void reply_ipc_clients(ipc_client_t *client);
+static void publish_ipc_event(ipc_event_t event, const client_t *client);
+
+/* Stats */
+static void dump_stats(int fd);
+static size_t format_stats(char *buffer, size_t size);
+static const char *get_event_name(uint32_t type);
+/* Commands that map onto keymap handlers, called with a synthetic key press */
+static void (*const IPC_HANDLERS[NUM_IPC_OPS])(
+    xcb_key_press_event_t *event, keymap_data_t data
+) = {
+  [IPC_OP_QUIT] = handle_keymap_quit,
+  [IPC_OP_RESTART] = handle_keymap_restart,
+  [IPC_OP_DESTROY] = handle_keymap_destroy,
+  [IPC_OP_SPAWN] = handle_keymap_spawnprocess,
+  [IPC_OP_MOVE] = handle_keymap_move,
+  [IPC_OP_TILE] = handle_keymap_tile,
+  [IPC_OP_VIEW] = handle_keymap_view,
+  [IPC_OP_SEND] = handle_keymap_send,
+};
 
 /* XCB handlers */
+/*
+ * Requests are sent unchecked, so errors arrive in the event queue with a
+ * response type of 0. XCB doesn't name that "event", so name it here
+ */
+#define XCB_ERROR 0
+typedef xcb_generic_error_t xcb_error_event_t;
 #define DECLARE_HANDLER(event, ident)\
 static void handle_xcb_##ident (xcb_##ident##_event_t *event);\
 static void event_handler_##event (xcb_generic_event_t *event) {\
+  STATS_BEGIN();\
   handle_xcb_##ident((xcb_##ident##_event_t *)event);\
+  STATS_END(XCB_##event);\
 }
+DECLARE_HANDLER(ERROR, error)
 DECLARE_HANDLER(CREATE_NOTIFY, create_notify)
 DECLARE_HANDLER(DESTROY_NOTIFY, destroy_notify)
 DECLARE_HANDLER(MAP_NOTIFY, map_notify)
@@ -93,16 +531,22 @@ DECLARE_HANDLER(UNMAP_NOTIFY, unmap_notify)
 DECLARE_HANDLER(REPARENT_NOTIFY, reparent_notify)
 DECLARE_HANDLER(CONFIGURE_NOTIFY, configure_notify)
 DECLARE_HANDLER(GRAVITY_NOTIFY, gravity_notify)
+DECLARE_HANDLER(PROPERTY_NOTIFY, property_notify)
+DECLARE_HANDLER(EXPOSE, expose)
 DECLARE_HANDLER(MAP_REQUEST, map_request)
 DECLARE_HANDLER(CONFIGURE_REQUEST, configure_request)
 DECLARE_HANDLER(CIRCULATE_REQUEST, circulate_request)
 DECLARE_HANDLER(KEY_PRESS, key_press)
 DECLARE_HANDLER(KEY_RELEASE, key_release)
+DECLARE_HANDLER(BUTTON_PRESS, button_press)
+DECLARE_HANDLER(BUTTON_RELEASE, button_release)
+DECLARE_HANDLER(MOTION_NOTIFY, motion_notify)
 DECLARE_HANDLER(FOCUS_IN, focus_in)
 DECLARE_HANDLER(FOCUS_OUT, focus_out)
 #undef DECLARE_HANDLER
 static void (*EVENT_HANDLERS[])(xcb_generic_event_t *) = {
 #define ADD_HANDLER(event) [XCB_##event] = event_handler_##event,
+  ADD_HANDLER(ERROR)
   ADD_HANDLER(CREATE_NOTIFY)
   ADD_HANDLER(DESTROY_NOTIFY)
   ADD_HANDLER(MAP_NOTIFY)
@@ -110,14 +554,58 @@ static void (*EVENT_HANDLERS[])(xcb_generic_event_t *) = {
   ADD_HANDLER(REPARENT_NOTIFY)
   ADD_HANDLER(CONFIGURE_NOTIFY)
   ADD_HANDLER(GRAVITY_NOTIFY)
+  ADD_HANDLER(PROPERTY_NOTIFY)
+  ADD_HANDLER(EXPOSE)
   ADD_HANDLER(MAP_REQUEST)
   ADD_HANDLER(CONFIGURE_REQUEST)
   ADD_HANDLER(CIRCULATE_REQUEST)
   ADD_HANDLER(KEY_PRESS)
   ADD_HANDLER(KEY_RELEASE)
+  ADD_HANDLER(BUTTON_PRESS)
+  ADD_HANDLER(BUTTON_RELEASE)
+  ADD_HANDLER(MOTION_NOTIFY)
   ADD_HANDLER(FOCUS_IN)
   ADD_HANDLER(FOCUS_OUT)
 #undef ADD_HANDLER
 };
+static const char *EVENT_NAMES[] = {
+#define ADD_NAME(event) [XCB_##event] = #event,
+  ADD_NAME(ERROR)
+  ADD_NAME(CREATE_NOTIFY)
+  ADD_NAME(DESTROY_NOTIFY)
+  ADD_NAME(MAP_NOTIFY)
+  ADD_NAME(UNMAP_NOTIFY)
+  ADD_NAME(REPARENT_NOTIFY)
+  ADD_NAME(CONFIGURE_NOTIFY)
+  ADD_NAME(GRAVITY_NOTIFY)
+  ADD_NAME(PROPERTY_NOTIFY)
+  ADD_NAME(EXPOSE)
+  ADD_NAME(MAP_REQUEST)
+  ADD_NAME(CONFIGURE_REQUEST)
+  ADD_NAME(CIRCULATE_REQUEST)
+  ADD_NAME(KEY_PRESS)
+  ADD_NAME(KEY_RELEASE)
+  ADD_NAME(BUTTON_PRESS)
+  ADD_NAME(BUTTON_RELEASE)
+  ADD_NAME(MOTION_NOTIFY)
+  ADD_NAME(FOCUS_IN)
+  ADD_NAME(FOCUS_OUT)
+#undef ADD_NAME
+};
+
+/* XKB handlers (XKB has one event type, with the kind of event in xkbType) */
+typedef union {
+  struct {
+    uint8_t response_type;
+    uint8_t xkbType;
+    uint16_t sequence;
+    xcb_timestamp_t time;
+    uint8_t deviceID;
+  } any;
+  xcb_xkb_new_keyboard_notify_event_t new_keyboard_notify;
+  xcb_xkb_map_notify_event_t map_notify;
+  xcb_xkb_state_notify_event_t state_notify;
+} xkb_event_t;
+static void handle_xkb_event(xkb_event_t *event);
 
 #endif /* PWM_H */
@@ -0,0 +1,82 @@
+/* Include guard */
+#ifndef RENDER_H
+#define RENDER_H
+
+/* Includes */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <config.h>
+
+/*
+ * Text rendering off the event loop. The event thread queues jobs to a
+ * worker over a single producer, single consumer ring, and the worker lays
+ * out the text with a built-in bitmap font and fills a ZPixmap image, ready
+ * to be sent with one PutImage. Finished images come back over another ring,
+ * with an eventfd made readable for the event loop, so rendering never holds
+ * up an event and the event thread stays the only one using the X connection.
+ *
+ * Without RENDER_THREAD, jobs are rendered as they're queued, and still come
+ * back through the same ring and eventfd
+ */
+#define RENDER_QUEUE_SIZE 64   /* Jobs in flight at once (power of two) */
+#define RENDER_TEXT_SIZE 256   /* Longer text is cut short */
+#define RENDER_MAX_WIDTH 8192
+#define RENDER_MAX_HEIGHT 256
+#define RENDER_FONT_WIDTH 6    /* Of a glyph's cell, at scale 1 */
+#define RENDER_FONT_HEIGHT 8
+
+typedef enum {
+  RENDER_ALIGN_LEFT,
+  RENDER_ALIGN_CENTER,
+  RENDER_ALIGN_RIGHT
+} render_align_t;
+typedef struct {
+  /* Where the image goes, only passed back */
+  uint32_t drawable;
+  uint32_t gc;
+  int16_t x;
+  int16_t y;
+  uint64_t tag;         /* The caller's, to tell outdated images apart */
+  /* What goes in it */
+  uint16_t width;
+  uint16_t height;
+  uint16_t scale;       /* Pixels per font pixel, 0 for 1 */
+  uint16_t padding;     /* Kept clear at either end */
+  render_align_t align;
+  uint32_t foreground;  /* 0xRRGGBB */
+  uint32_t background;
+  char text[RENDER_TEXT_SIZE]; /* UTF-8, anything past ASCII shows as ? */
+} render_job_t;
+typedef struct {
+  uint32_t drawable;
+  uint32_t gc;
+  int16_t x;
+  int16_t y;
+  uint64_t tag;
+  uint16_t width;
+  uint16_t height;
+  uint32_t *pixels;     /* 32 bits per pixel, rows back to back */
+  uint64_t queued_ns;   /* How long it took, from being queued to being done */
+} render_image_t;
+
+/*
+ * Start the worker. Returns the eventfd to watch for finished images, or -1
+ * if it can't be made, in which case nothing can be rendered
+ */
+extern int render_init(void);
+extern void render_cleanup(void);
+
+/* Copies the job. False when RENDER_QUEUE_SIZE jobs are already in flight */
+extern bool render_submit(const render_job_t *job);
+/* Takes the next finished image, false when there are none */
+extern bool render_collect(render_image_t *image);
+extern void render_release(render_image_t *image);
+
+/* Width of the text alone, for laying things out before rendering them */
+extern uint32_t render_text_width(const char *text, uint16_t scale);
+
+/* One line of counters, returning the length like snprintf() */
+extern size_t render_format(char *buffer, size_t size);
+
+#endif /* RENDER_H */
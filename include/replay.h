@@ -0,0 +1,24 @@
+/* Include guard */
+#ifndef REPLAY_H
+#define REPLAY_H
+
+/* Includes */
+#include <stdint.h>
+#include <xcb/xcb.h>
+
+/*
+ * A stand-in X server for replaying traces. XCB is connected to one end of a
+ * socket pair, and a thread on the other end reads every request and throws
+ * it away, answering the ones that need a reply with an empty one (atoms get
+ * made-up values). No extensions are present, so the WM runs as it would on a
+ * bare server with one screen of the given size
+ */
+extern xcb_connection_t *replay_connect(uint16_t width, uint16_t height);
+
+/* Requests the stand-in server has swallowed so far */
+extern uint64_t replay_requests(void);
+
+/* Stop the server thread, after the connection has been closed */
+extern void replay_cleanup(void);
+
+#endif /* REPLAY_H */
@@ -0,0 +1,49 @@
+/* Include guard */
+#ifndef RULES_H
+#define RULES_H
+
+/* Includes */
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Window rules. A rule matches a window's class, instance and title, each
+ * either exactly or as a glob where * matches any run of characters and ? any
+ * one, and says where the window goes. Fields a rule leaves NULL match
+ * anything.
+ *
+ * Rules are compiled once: exact strings go into a hash table per field, and
+ * every glob of a field into one automaton, run as bit vectors over the
+ * string. Matching a window is then a hash lookup and one pass over each of
+ * its strings, however many rules there are
+ */
+typedef enum {
+  RULE_CLASS,
+  RULE_INSTANCE,
+  RULE_TITLE,
+  RULE_FIELDS
+} rule_field_t;
+typedef struct {
+  const char *patterns[RULE_FIELDS];
+  int8_t floating;    /* 1 floats, 0 tiles, -1 leaves it be */
+  int32_t workspace;  /* From 1, 0 leaves it be */
+  int32_t output;     /* From 1, 0 leaves it be */
+} rule_t;
+typedef struct rules rules_t;
+
+/* Patterns are copied. NULL when out of memory */
+extern rules_t *rules_compile(const rule_t *rules, uint32_t num_rules);
+
+/*
+ * Fills result with what the matching rules say, taken in order so later ones
+ * override earlier ones, and leaving be whatever none of them set. NULL
+ * strings are matched as empty. Returns whether any rule matched
+ */
+extern bool rules_match(
+    const rules_t *rules, const char *const strings[RULE_FIELDS],
+    rule_t *result
+);
+extern uint32_t rules_count(const rules_t *rules);
+extern void rules_free(rules_t *rules);
+
+#endif /* RULES_H */
@@ -0,0 +1,84 @@
+/* Include guard */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/* Includes */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <config.h> /* For WORKSPACES */
+#include <layout.h> /* For rect_t */
+
+/*
+ * State snapshots, for restarting into. The outputs, their workspaces and
+ * every client's place are kept in a memory-mapped file of fixed size
+ * records, one per client id, so bringing it up to date only rewrites the
+ * records that changed and the kernel writes back just the pages they're on.
+ *
+ * The sequence number is odd while records are being written, so a snapshot
+ * left behind by a crash in the middle of an update is never loaded. Window
+ * ids are only meaningful to the server they came from, so the token has to
+ * match the one left on its root window too
+ */
+#define SNAPSHOT_MAGIC "pwmstate"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_OUTPUTS 16
+#define SNAPSHOT_NO_FOCUS UINT32_MAX /* Never focused */
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t sequence;       /* Odd while being written */
+  uint32_t root;           /* Of the screen it was taken on */
+  uint32_t capacity;       /* Client records */
+  uint32_t num_outputs;
+  uint32_t current_output;
+  uint64_t token;          /* Also on the root, to tell servers apart */
+} snapshot_header_t;
+typedef struct {
+  uint32_t crtc;
+  rect_t area;
+  uint32_t workspace;      /* The one being shown */
+  uint8_t layouts[WORKSPACES];
+} snapshot_output_t;
+typedef struct {
+  uint32_t window;         /* 0 for a free record */
+  uint32_t frame;
+  uint32_t output;
+  uint32_t workspace;
+  uint32_t order;          /* In its workspace's layout */
+  uint32_t focus;          /* In the focus order, most recent first */
+  rect_t rect;             /* Of the frame, as last sent */
+  uint8_t floating;
+  uint8_t hidden;          /* Unmapped by pwm, its workspace wasn't shown */
+  uint8_t frame_kept;      /* The frame outlives pwm, the client in it */
+  uint8_t iconic;          /* Managed but unmapped, in no workspace */
+} snapshot_client_t;
+
+/* A snapshot mapped for reading */
+typedef struct {
+  const snapshot_header_t *header;
+  const snapshot_output_t *outputs;
+  const snapshot_client_t *clients;
+  size_t size;
+} snapshot_t;
+
+/* From PWM_SNAPSHOT or else XDG_RUNTIME_DIR and DISPLAY, like the socket */
+extern void snapshot_path(char *path, size_t size);
+
+/* Writing. Records are only valid between snapshot_begin() and _end() */
+extern bool snapshot_open(const char *path, uint32_t root, uint64_t token);
+extern bool snapshot_writing(void);
+extern snapshot_header_t *snapshot_begin(void);
+extern snapshot_output_t *snapshot_output(uint32_t index);
+/* Grows the file to hold the id, NULL when it can't */
+extern snapshot_client_t *snapshot_client(uint32_t id);
+extern void snapshot_end(void);
+extern void snapshot_close(void);
+
+/* Reading, false unless it's complete and for the same root */
+extern bool snapshot_load(
+    const char *path, uint32_t root, snapshot_t *snapshot
+);
+extern void snapshot_unload(snapshot_t *snapshot);
+
+#endif /* SNAPSHOT_H */
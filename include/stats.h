@@ -0,0 +1,48 @@
+/* Include guard */
+#ifndef STATS_H
+#define STATS_H
+
+/* Includes */
+#include <stdint.h>
+#include <stddef.h>
+#include <config.h>
+
+/*
+ * Event timing. Each event type gets a count, a log-bucketed histogram of
+ * handler latencies and a count of the round trips to the X server made while
+ * handling it. Slot STATS_LOOP covers a whole event loop pass, from waking up to
+ * the flush. With STATS unset the hooks compile to nothing
+ */
+#define STATS_TYPES 128 /* Event types, without the synthetic bit */
+#define STATS_LOOP STATS_TYPES
+typedef struct {
+  uint64_t time;
+  uint64_t round_trips;
+} stats_mark_t;
+
+/* Blocking waits on the server so far, bumped by STATS_ROUND_TRIP() */
+extern uint64_t stats_round_trips;
+
+extern stats_mark_t stats_begin(void);
+extern void stats_end(uint32_t type, stats_mark_t mark);
+
+/*
+ * Write a table of every type seen so far, naming types with name (which may
+ * return NULL for unnamed types). Returns the length written, like snprintf()
+ */
+extern size_t stats_format(
+    char *buffer, size_t size, const char *(*name)(uint32_t type)
+);
+
+/* Hooks */
+#if STATS
+#define STATS_BEGIN() stats_mark_t stats_mark = stats_begin()
+#define STATS_END(type) stats_end((type), stats_mark)
+#define STATS_ROUND_TRIP() ((void)stats_round_trips++)
+#else
+#define STATS_BEGIN() ((void)0)
+#define STATS_END(type) ((void)0)
+#define STATS_ROUND_TRIP() ((void)0)
+#endif
+
+#endif /* STATS_H */
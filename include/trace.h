@@ -0,0 +1,52 @@
+/* Include guard */
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Includes */
+#include <stdint.h>
+#include <stdbool.h>
+#include <xcb/xcb.h>
+
+/*
+ * Event traces. Every event read from the server is copied, with a timestamp
+ * and the batch it arrived in, into a ring of fixed size records in a
+ * memory-mapped file, so recording costs a memcpy() per event and the kernel
+ * writes the file back. Once the ring is full the oldest records are
+ * overwritten, so a trace always holds the events leading up to a problem
+ */
+#define TRACE_MAGIC "pwmtrace"
+#define TRACE_VERSION 1
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t capacity; /* Records, a power of two */
+  uint64_t written;  /* Records ever written, the ring's head */
+} trace_header_t;
+typedef struct {
+  uint64_t time;  /* CLOCK_MONOTONIC nanoseconds */
+  uint32_t batch; /* Events sharing a batch were handled together */
+  uint32_t pad;
+  uint8_t event[32];
+} trace_record_t;
+
+/* A trace mapped for reading, oldest record first */
+typedef struct {
+  const trace_header_t *header;
+  const trace_record_t *records;
+  uint64_t first; /* Index of the oldest record still in the ring */
+  uint64_t count;
+  size_t size;
+} trace_t;
+
+/* Recording */
+extern bool trace_open(const char *path, uint32_t capacity);
+extern void trace_record(xcb_generic_event_t *const *events, uint32_t num_events);
+extern void trace_close(void);
+extern bool trace_recording(void);
+
+/* Reading */
+extern bool trace_load(const char *path, trace_t *trace);
+extern const trace_record_t *trace_get(const trace_t *trace, uint64_t i);
+extern void trace_unload(trace_t *trace);
+
+#endif /* TRACE_H */
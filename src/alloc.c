@@ -0,0 +1,173 @@
+/* Implements alloc.h */
+#include <alloc.h>
+
+/* Includes */
+#include <stdio.h>  /* For snprintf() */
+#include <stdlib.h> /* For malloc(), calloc(), realloc(), free() */
+#include <string.h> /* For memset() */
+#include <logging.h>
+
+/* Constants */
+#define ALLOC_ALIGN (sizeof(max_align_t))
+
+/* Arena */
+struct arena_block {
+  arena_block_t *next;
+  max_align_t data[];
+};
+static size_t arena_round(size_t size) {
+  return (size + ALLOC_ALIGN - 1) & ~(ALLOC_ALIGN - 1);
+}
+void arena_init(arena_t *arena, size_t size) {
+  *arena = (arena_t){ 0 };
+  arena->size = arena_round(size);
+  arena->base = malloc(arena->size);
+  if (!arena->base) LOG_ERROR("Failed to allocate %zu byte arena", size);
+}
+void *arena_alloc(arena_t *arena, size_t size) {
+  size = arena_round(size ? size : 1);
+  arena->allocations++;
+  if (size <= arena->size - arena->used) {
+    void *pointer = arena->base + arena->used;
+    arena->used += size;
+    if (arena->used + arena->spilled_size > arena->peak)
+      arena->peak = arena->used + arena->spilled_size;
+    return pointer;
+  }
+  /* Spilled blocks only last until the reset that regrows the arena */
+  arena_block_t *block = malloc(sizeof(arena_block_t) + size);
+  if (!block) LOG_ERROR("Failed to allocate %zu bytes", size);
+  block->next = arena->spilled;
+  arena->spilled = block;
+  arena->spilled_size += size;
+  arena->spills++;
+  if (arena->used + arena->spilled_size > arena->peak)
+    arena->peak = arena->used + arena->spilled_size;
+  return block->data;
+}
+void arena_reset(arena_t *arena) {
+  arena->resets++;
+  if (arena->spilled) {
+    while (arena->spilled) {
+      arena_block_t *next = arena->spilled->next;
+      free(arena->spilled);
+      arena->spilled = next;
+    }
+    /* Grow to the next power of two that held the whole pass */
+    size_t size = arena->size;
+    while (size < arena->used + arena->spilled_size) size *= 2;
+    char *base = malloc(size);
+    if (base) {
+      free(arena->base);
+      arena->base = base;
+      arena->size = size;
+      arena->grows++;
+    }
+    arena->spilled_size = 0;
+  }
+  arena->used = 0;
+}
+void arena_free(arena_t *arena) {
+  arena_reset(arena);
+  free(arena->base);
+  *arena = (arena_t){ 0 };
+}
+
+/* Pool */
+void pool_init(pool_t *pool, size_t record_size, uint32_t chunk_records) {
+  *pool = (pool_t){
+    .record_size = arena_round(record_size),
+    .chunk_records = chunk_records
+  };
+}
+void *pool_alloc(pool_t *pool, uint32_t *index) {
+  if (!pool->num_free) {
+    /* The free stack has room for every record, so releasing never fails */
+    uint32_t capacity = pool_capacity(pool) + pool->chunk_records;
+    char **chunks =
+      realloc(pool->chunks, sizeof(char *)*(pool->num_chunks + 1));
+    if (!chunks) return NULL;
+    pool->chunks = chunks;
+    uint32_t *free_records =
+      realloc(pool->free_records, sizeof(uint32_t)*capacity);
+    if (!free_records) return NULL;
+    pool->free_records = free_records;
+    bool *allocated = realloc(pool->allocated, sizeof(bool)*capacity);
+    if (!allocated) return NULL;
+    memset(
+        allocated + capacity - pool->chunk_records, 0,
+        sizeof(bool)*pool->chunk_records
+    );
+    pool->allocated = allocated;
+    char *chunk = calloc(pool->chunk_records, pool->record_size);
+    if (!chunk) return NULL;
+    pool->chunks[pool->num_chunks++] = chunk;
+    /* Lowest indices on top, handed out first */
+    for (uint32_t i = capacity; i-- > capacity - pool->chunk_records;)
+      pool->free_records[pool->num_free++] = i;
+  }
+  uint32_t record = pool->free_records[--pool->num_free];
+  void *pointer = pool_get(pool, record);
+  memset(pointer, 0, pool->record_size);
+  pool->allocated[record] = true;
+  if (index) *index = record;
+  pool->used++;
+  if (pool->used > pool->peak) pool->peak = pool->used;
+  pool->allocations++;
+  return pointer;
+}
+bool pool_release(pool_t *pool, void *record, uint32_t index) {
+  /* Pushing an index twice would hand the record out twice */
+  if (index >= pool_capacity(pool) || !pool->allocated[index]
+      || record != pool_get(pool, index)) {
+    LOG_WARNING("Released record %u isn't allocated", index);
+    return false;
+  }
+  pool->allocated[index] = false;
+  pool->free_records[pool->num_free++] = index;
+  pool->used--;
+  return true;
+}
+void *pool_get(const pool_t *pool, uint32_t index) {
+  if (index >= pool_capacity(pool)) return NULL;
+  return pool->chunks[index/pool->chunk_records]
+    + (size_t)(index%pool->chunk_records)*pool->record_size;
+}
+uint32_t pool_capacity(const pool_t *pool) {
+  return pool->num_chunks*pool->chunk_records;
+}
+void pool_free(pool_t *pool) {
+  for (uint32_t i = 0; i < pool->num_chunks; i++) free(pool->chunks[i]);
+  free(pool->chunks);
+  free(pool->free_records);
+  free(pool->allocated);
+  *pool = (pool_t){
+    .record_size = pool->record_size,
+    .chunk_records = pool->chunk_records
+  };
+}
+
+/* Counters */
+size_t arena_format(
+    char *buffer, size_t size, const char *name, const arena_t *arena
+) {
+  return snprintf(
+      buffer, size,
+      "%-12s size %zu peak %zu allocations %llu resets %llu spills %llu"
+      " grows %llu\n",
+      name, arena->size, arena->peak,
+      (unsigned long long)arena->allocations,
+      (unsigned long long)arena->resets, (unsigned long long)arena->spills,
+      (unsigned long long)arena->grows
+  );
+}
+size_t pool_format(
+    char *buffer, size_t size, const char *name, const pool_t *pool
+) {
+  return snprintf(
+      buffer, size,
+      "%-12s records %u used %u peak %u chunks %u allocations %llu\n",
+      name, pool_capacity(pool), pool->used, pool->peak, pool->num_chunks,
+      (unsigned long long)pool->allocations
+  );
+}
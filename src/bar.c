@@ -0,0 +1,120 @@
+/* Implements bar.h */
+#include <bar.h>
+
+/* Includes */
+#include <string.h> /* For memcpy(), strlen() */
+
+/* Fingerprints */
+static uint64_t bar_hash(uint64_t hash, const void *data, size_t size) {
+  /* FNV-1a */
+  for (const unsigned char *c = data; size--; c++)
+    hash = (hash ^ *c)*1099511628211ull;
+  return hash;
+}
+static uint64_t bar_fingerprint(const bar_segment_t *segment) {
+  uint64_t hash = 14695981039346656037ull;
+  hash = bar_hash(hash, segment->text, strlen(segment->text));
+  hash = bar_hash(hash, &segment->foreground, sizeof(segment->foreground));
+  hash = bar_hash(hash, &segment->background, sizeof(segment->background));
+  hash = bar_hash(hash, &segment->x, sizeof(segment->x));
+  hash = bar_hash(hash, &segment->width, sizeof(segment->width));
+  /* 0 is kept for never drawn */
+  return hash ? hash : 1;
+}
+
+/* Segments */
+void bar_init(
+    bar_t *bar, uint16_t width, uint16_t height, uint16_t scale,
+    uint16_t padding
+) {
+  *bar = (bar_t){
+    .width = width, .height = height, .scale = scale ? scale : 1,
+    .padding = padding
+  };
+}
+uint32_t bar_add(bar_t *bar, bar_side_t side) {
+  if (bar->num_segments == BAR_MAX_SEGMENTS) return BAR_MAX_SEGMENTS - 1;
+  bar->segments[bar->num_segments] = (bar_segment_t){ .side = side };
+  return bar->num_segments++;
+}
+void bar_set(
+    bar_t *bar, uint32_t segment, const char *text, uint32_t foreground,
+    uint32_t background
+) {
+  bar_segment_t *set = &bar->segments[segment];
+  size_t length = text ? strlen(text) : 0;
+  if (length >= RENDER_TEXT_SIZE) length = RENDER_TEXT_SIZE - 1;
+  if (length) memcpy(set->text, text, length);
+  set->text[length] = '\0';
+  set->foreground = foreground;
+  set->background = background;
+}
+void bar_resize(bar_t *bar, uint16_t width) {
+  bar->width = width;
+  for (uint32_t s = 0; s < bar->num_segments; s++)
+    bar->segments[s].fingerprint = 0;
+}
+
+/* Layout */
+static uint16_t bar_segment_width(
+    const bar_t *bar, const bar_segment_t *segment
+) {
+  if (!segment->text[0]) return 0;
+  uint32_t width =
+    render_text_width(segment->text, bar->scale) + 2u*bar->padding;
+  return width < UINT16_MAX ? width : UINT16_MAX;
+}
+uint32_t bar_layout(bar_t *bar) {
+  /* Left ones first, then right ones in what's left, and the rest is filled */
+  uint32_t left = 0;
+  uint32_t right = bar->width;
+  for (uint32_t s = 0; s < bar->num_segments; s++) {
+    bar_segment_t *segment = &bar->segments[s];
+    if (segment->side != BAR_LEFT) continue;
+    uint32_t width = bar_segment_width(bar, segment);
+    if (width > bar->width - left) width = bar->width - left;
+    segment->x = left;
+    segment->width = width;
+    left += width;
+  }
+  for (uint32_t s = bar->num_segments; s-- > 0;) {
+    bar_segment_t *segment = &bar->segments[s];
+    if (segment->side != BAR_RIGHT) continue;
+    uint32_t width = bar_segment_width(bar, segment);
+    if (width > right - left) width = right - left;
+    right -= width;
+    segment->x = right;
+    segment->width = width;
+  }
+  for (uint32_t s = 0; s < bar->num_segments; s++) {
+    bar_segment_t *segment = &bar->segments[s];
+    if (segment->side != BAR_FILL) continue;
+    /* Only the first gets any, more than one would overlap */
+    segment->x = left;
+    segment->width = right - left;
+    left = right;
+  }
+
+  uint32_t dirty = 0;
+  for (uint32_t s = 0; s < bar->num_segments; s++) {
+    bar_segment_t *segment = &bar->segments[s];
+    uint64_t fingerprint = bar_fingerprint(segment);
+    if (fingerprint != segment->fingerprint) {
+      segment->fingerprint = fingerprint;
+      segment->generation++;
+      segment->dirty = true;
+    }
+    dirty += segment->dirty;
+  }
+  return dirty;
+}
+void bar_job(const bar_t *bar, uint32_t segment, render_job_t *job) {
+  const bar_segment_t *draw = &bar->segments[segment];
+  *job = (render_job_t){
+    .x = draw->x, .width = draw->width, .height = bar->height,
+    .scale = bar->scale, .padding = bar->padding,
+    .align = draw->side == BAR_RIGHT ? RENDER_ALIGN_RIGHT : RENDER_ALIGN_LEFT,
+    .foreground = draw->foreground, .background = draw->background
+  };
+  memcpy(job->text, draw->text, sizeof(job->text));
+}
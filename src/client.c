@@ -0,0 +1,196 @@
+/* Implements client.h */
+#include <client.h>
+
+/* Includes */
+#include <stdlib.h> /* For calloc(), free() */
+#include <logging.h>
+
+/* Constants */
+#define CLIENT_CHUNK_SIZE 64 /* Clients allocated at a time */
+#define CLIENT_MAP_MIN_CAPACITY 64 /* Power of two */
+
+/*
+ * Clients live in a slab pool, so a client's address and id stay the same
+ * for as long as it's managed, and a week of windows coming and going reuses
+ * the same few chunks
+ */
+static pool_t clients = {
+  .record_size = sizeof(client_t), .chunk_records = CLIENT_CHUNK_SIZE
+};
+
+/*
+ * Open-addressing hash map from window to client, with linear probing.
+ * Window 0 (None) marks an empty slot, and removal shifts later entries back
+ * rather than leaving tombstones, so lookups never scan past a gap
+ */
+typedef struct {
+  xcb_window_t window;
+  client_t *client;
+} client_map_entry_t;
+static client_map_entry_t *client_map = NULL;
+static uint32_t client_map_capacity = 0;
+static uint32_t client_map_size = 0;
+
+static uint32_t client_map_slot(xcb_window_t window) {
+  return (window * 2654435761u) & (client_map_capacity - 1);
+}
+static void client_map_insert(xcb_window_t window, client_t *client);
+static void client_map_grow(void) {
+  client_map_entry_t *old_map = client_map;
+  uint32_t old_capacity = client_map_capacity;
+  client_map_capacity = old_capacity
+    ? old_capacity*2 : CLIENT_MAP_MIN_CAPACITY;
+  client_map = calloc(client_map_capacity, sizeof(client_map_entry_t));
+  if (!client_map)
+    LOG_ERROR("Failed to allocate client map of %d", client_map_capacity);
+  client_map_size = 0;
+  for (uint32_t i = 0; i < old_capacity; i++)
+    if (old_map[i].window)
+      client_map_insert(old_map[i].window, old_map[i].client);
+  free(old_map);
+}
+static void client_map_insert(xcb_window_t window, client_t *client) {
+  /* Keep the load factor under 3/4 */
+  if ((client_map_size + 1)*4 > client_map_capacity*3) client_map_grow();
+  uint32_t slot = client_map_slot(window);
+  while (client_map[slot].window && client_map[slot].window != window)
+    slot = (slot + 1) & (client_map_capacity - 1);
+  if (!client_map[slot].window) client_map_size++;
+  client_map[slot].window = window;
+  client_map[slot].client = client;
+}
+static void client_map_remove(xcb_window_t window) {
+  if (!client_map_capacity) return;
+  uint32_t mask = client_map_capacity - 1;
+  uint32_t slot = client_map_slot(window);
+  while (client_map[slot].window != window) {
+    if (!client_map[slot].window) return;
+    slot = (slot + 1) & mask;
+  }
+  /* Shift back any entries that probed past this slot */
+  uint32_t next = slot;
+  for (;;) {
+    next = (next + 1) & mask;
+    if (!client_map[next].window) break;
+    uint32_t home = client_map_slot(client_map[next].window);
+    if (((next - home) & mask) >= ((next - slot) & mask)) {
+      client_map[slot] = client_map[next];
+      slot = next;
+    }
+  }
+  client_map[slot].window = 0;
+  client_map[slot].client = NULL;
+  client_map_size--;
+}
+
+/* Client table */
+client_t *client_add(xcb_window_t window) {
+  uint32_t id;
+  client_t *client = pool_alloc(&clients, &id);
+  if (!client) LOG_ERROR("Failed to allocate clients");
+  client->id = id;
+  client->window = window;
+  client_map_insert(window, client);
+  return client;
+}
+client_t *client_find(xcb_window_t window) {
+  if (!client_map_capacity || !window) return NULL;
+  uint32_t slot = client_map_slot(window);
+  while (client_map[slot].window) {
+    if (client_map[slot].window == window) return client_map[slot].client;
+    slot = (slot + 1) & (client_map_capacity - 1);
+  }
+  return NULL;
+}
+void client_set_frame(client_t *client, xcb_window_t frame) {
+  if (client->frame) client_map_remove(client->frame);
+  client->frame = frame;
+  if (frame) client_map_insert(frame, client);
+}
+client_t *client_get(uint32_t id) {
+  /* Records of removed clients are left with no window */
+  client_t *client = pool_get(&clients, id);
+  return client && client->window ? client : NULL;
+}
+void client_remove(client_t *client) {
+  client_map_remove(client->window);
+  if (client->frame) client_map_remove(client->frame);
+  client->window = 0;
+  free(client->instance);
+  client->instance = NULL;
+  client->class_name = NULL;
+  free(client->net_name);
+  client->net_name = NULL;
+  free(client->name);
+  client->name = NULL;
+  pool_release(&clients, client, client->id);
+}
+uint32_t client_count(void) {
+  return clients.used;
+}
+const char *client_title(const client_t *client) {
+  return client->net_name ? client->net_name : client->name;
+}
+const pool_t *client_pool(void) {
+  return &clients;
+}
+void client_cleanup(void) {
+  pool_free(&clients);
+  free(client_map);
+  client_map = NULL;
+  client_map_capacity = 0;
+  client_map_size = 0;
+}
+
+/* Layout order */
+void client_list_append(client_list_t *list, client_t *client) {
+  client->prev = list->tail;
+  client->next = NULL;
+  if (list->tail) list->tail->next = client;
+  else list->head = client;
+  list->tail = client;
+  list->count++;
+}
+void client_list_remove(client_list_t *list, client_t *client) {
+  if (client->prev) client->prev->next = client->next;
+  else list->head = client->next;
+  if (client->next) client->next->prev = client->prev;
+  else list->tail = client->prev;
+  client->prev = NULL;
+  client->next = NULL;
+  list->count--;
+}
+
+/* Focus order */
+void client_focus_touch(client_list_t *list, client_t *client) {
+  if (list->head == client) return;
+  if (client->in_focus_order) client_focus_remove(list, client);
+  client->focus_prev = NULL;
+  client->focus_next = list->head;
+  if (list->head) list->head->focus_prev = client;
+  else list->tail = client;
+  list->head = client;
+  client->in_focus_order = true;
+  list->count++;
+}
+void client_focus_append(client_list_t *list, client_t *client) {
+  if (client->in_focus_order) return;
+  client->focus_prev = list->tail;
+  client->focus_next = NULL;
+  if (list->tail) list->tail->focus_next = client;
+  else list->head = client;
+  list->tail = client;
+  client->in_focus_order = true;
+  list->count++;
+}
+void client_focus_remove(client_list_t *list, client_t *client) {
+  if (!client->in_focus_order) return;
+  if (client->focus_prev) client->focus_prev->focus_next = client->focus_next;
+  else list->head = client->focus_next;
+  if (client->focus_next) client->focus_next->focus_prev = client->focus_prev;
+  else list->tail = client->focus_prev;
+  client->focus_prev = NULL;
+  client->focus_next = NULL;
+  client->in_focus_order = false;
+  list->count--;
+}
@@ -0,0 +1,264 @@
+/* Implements config_file.h */
+#include <config_file.h>
+
+/* Includes */
+#include <errno.h>  /* For errno */
+#include <stdio.h>  /* For fopen(), fread(), snprintf() */
+#include <stdlib.h> /* For malloc(), free(), getenv(), strtol() */
+#include <string.h> /* For strcmp(), strchr(), strerror() */
+#include <strings.h> /* For strcasecmp() */
+#include <xcb/xcb.h> /* For XCB_MOD_MASK_* */
+#include <logging.h>
+
+/* Constants */
+#define CONFIG_MAX_SIZE (1 << 20)
+#define CONFIG_MAX_WORDS 64 /* Per line */
+static const struct {
+  const char *name;
+  uint16_t mask;
+} CONFIG_MODIFIERS[] = {
+  { "Shift", XCB_MOD_MASK_SHIFT },
+  { "Lock", XCB_MOD_MASK_LOCK },
+  { "Control", XCB_MOD_MASK_CONTROL },
+  { "Ctrl", XCB_MOD_MASK_CONTROL },
+  { "Mod1", XCB_MOD_MASK_1 },
+  { "Alt", XCB_MOD_MASK_1 },
+  { "Mod2", XCB_MOD_MASK_2 },
+  { "Mod3", XCB_MOD_MASK_3 },
+  { "Mod4", XCB_MOD_MASK_4 },
+  { "Super", XCB_MOD_MASK_4 },
+  { "Mod5", XCB_MOD_MASK_5 },
+};
+#define NUM_CONFIG_MODIFIERS (sizeof(CONFIG_MODIFIERS)/sizeof(CONFIG_MODIFIERS[0]))
+
+/* Path */
+void config_file_path(char *path, size_t size) {
+  const char *file = getenv("PWM_CONFIG");
+  const char *config_home = getenv("XDG_CONFIG_HOME");
+  const char *home = getenv("HOME");
+  if (file)
+    snprintf(path, size, "%s", file);
+  else if (config_home)
+    snprintf(path, size, "%s/pwm/config", config_home);
+  else
+    snprintf(path, size, "%s/.config/pwm/config", home ? home : ".");
+}
+
+/* Parsing */
+static uint32_t config_split(char *line, char **words) {
+  /* Words are separated by spaces, and can be "quoted" to include them */
+  uint32_t num_words = 0;
+  char *c = line;
+  for (;;) {
+    while (*c == ' ' || *c == '\t') c++;
+    if (!*c || *c == '#') break;
+    if (num_words == CONFIG_MAX_WORDS) return num_words + 1;
+    if (*c == '"') {
+      words[num_words++] = ++c;
+      while (*c && *c != '"') c++;
+    } else {
+      words[num_words++] = c;
+      while (*c && *c != ' ' && *c != '\t') c++;
+    }
+    if (!*c) break;
+    *c++ = '\0';
+  }
+  return num_words;
+}
+static bool config_parse_key(
+    char *key, uint16_t *modifiers, xkb_keysym_t *keysym
+) {
+  /* Every +-separated part but the last is a modifier */
+  *modifiers = 0;
+  char *plus;
+  while ((plus = strchr(key, '+')) && plus[1]) {
+    *plus = '\0';
+    uint32_t i = 0;
+    while (i < NUM_CONFIG_MODIFIERS && strcasecmp(key, CONFIG_MODIFIERS[i].name))
+      i++;
+    if (i == NUM_CONFIG_MODIFIERS) return false;
+    *modifiers |= CONFIG_MODIFIERS[i].mask;
+    key = plus + 1;
+  }
+  *keysym = xkb_keysym_from_name(key, XKB_KEYSYM_NO_FLAGS);
+  if (*keysym == XKB_KEY_NoSymbol)
+    *keysym = xkb_keysym_from_name(key, XKB_KEYSYM_CASE_INSENSITIVE);
+  return *keysym != XKB_KEY_NoSymbol;
+}
+static const char *config_parse_rule(
+    char **words, uint32_t count, rule_t *rule
+) {
+  /* Words come in pairs of a key and its value, but for the flags */
+  static const char *const FIELDS[RULE_FIELDS] = {
+    [RULE_CLASS] = "class", [RULE_INSTANCE] = "instance",
+    [RULE_TITLE] = "title"
+  };
+  *rule = (rule_t){ .floating = -1 };
+  bool matches = false;
+  bool acts = false;
+  for (uint32_t i = 1; i < count; i++) {
+    uint32_t field = 0;
+    while (field < RULE_FIELDS && strcmp(words[i], FIELDS[field])) field++;
+    if (field < RULE_FIELDS) {
+      if (i + 1 == count) return "expected a pattern";
+      rule->patterns[field] = words[++i];
+      matches = true;
+    } else if (!strcmp(words[i], "floating") || !strcmp(words[i], "tiled")) {
+      rule->floating = !strcmp(words[i], "floating");
+      acts = true;
+    } else if (!strcmp(words[i], "workspace") || !strcmp(words[i], "output")) {
+      if (i + 1 == count) return "expected a number";
+      char *end = NULL;
+      long value = strtol(words[i + 1], &end, 0);
+      if (*end || value < 1 || value > INT32_MAX)
+        return "expected a number from 1";
+      if (!strcmp(words[i], "workspace")) rule->workspace = value;
+      else rule->output = value;
+      i++;
+      acts = true;
+    } else {
+      return "unknown rule word";
+    }
+  }
+  if (!matches) return "expected a class, instance or title";
+  if (!acts) return "expected floating, tiled, workspace or output";
+  return NULL;
+}
+static char *config_read(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    LOG_WARNING("Failed to open %s (%s)", path, strerror(errno));
+    return NULL;
+  }
+  char *text = malloc(CONFIG_MAX_SIZE + 1);
+  size_t length = text ? fread(text, 1, CONFIG_MAX_SIZE + 1, file) : 0;
+  bool failed = !text || ferror(file) || length > CONFIG_MAX_SIZE;
+  fclose(file);
+  if (failed) {
+    LOG_WARNING("Failed to read %s", path);
+    free(text);
+    return NULL;
+  }
+  text[length] = '\0';
+  return text;
+}
+bool config_file_load(
+    const char *path, const config_command_t *commands, uint32_t num_commands,
+    config_t *config
+) {
+  *config = (config_t){ 0 };
+  config->text = config_read(path);
+  if (!config->text) return false;
+
+  /* Sized for the worst case up front, so nothing moves while parsing */
+  uint32_t num_lines = 1;
+  uint32_t max_words = 0;
+  for (const char *c = config->text; *c; c++) {
+    num_lines += *c == '\n';
+    max_words += *c == ' ' || *c == '\t' || *c == '\n';
+  }
+  max_words += num_lines*2;
+  config->bindings = malloc(sizeof(config_binding_t)*num_lines);
+  config->rules = malloc(sizeof(rule_t)*num_lines);
+  config->words = malloc(sizeof(char *)*max_words);
+  if (!config->bindings || !config->rules || !config->words) {
+    config_file_free(config);
+    return false;
+  }
+
+  uint32_t num_words = 0;
+  uint32_t line_number = 0;
+  char *next = config->text;
+  while (next) {
+    char *line = next;
+    next = strchr(line, '\n');
+    if (next) *next++ = '\0';
+    line_number++;
+    char *words[CONFIG_MAX_WORDS];
+    uint32_t count = config_split(line, words);
+    if (!count) continue;
+
+    const char *error = NULL;
+    if (!strcmp(words[0], "rule")) {
+      error = count > CONFIG_MAX_WORDS ? "too many words" : config_parse_rule(
+          words, count, &config->rules[config->num_rules]
+      );
+      if (error) {
+        LOG_WARNING("%s:%u: %s", path, line_number, error);
+        config_file_free(config);
+        return false;
+      }
+      config->num_rules++;
+      continue;
+    }
+    config_binding_t *binding = &config->bindings[config->num_bindings];
+    uint32_t command = 0;
+    if (strcmp(words[0], "bind")) error = "unknown directive";
+    else if (count > CONFIG_MAX_WORDS) error = "too many words";
+    else if (count < 3) error = "expected a key and a command";
+    else if (!config_parse_key(words[1], &binding->modifiers, &binding->keysym))
+      error = "unknown key";
+    else {
+      while (command < num_commands && strcmp(words[2], commands[command].name))
+        command++;
+      if (command == num_commands) error = "unknown command";
+    }
+    if (!error) {
+      binding->command = command;
+      switch (commands[command].arg) {
+        case CONFIG_ARG_NONE:
+          if (count > 3) error = "command doesn't take an argument";
+          break;
+        case CONFIG_ARG_INT: {
+          const config_command_t *info = &commands[command];
+          uint32_t value = 0;
+          while (count > 3 && value < info->num_values
+              && strcmp(words[3], info->values[value]))
+            value++;
+          if (count > 3 && value < info->num_values) {
+            binding->arg.i32 = value;
+            if (count > 4) error = "expected one value";
+            break;
+          }
+          /* Nothing, an empty word and one that overflows aren't 0 */
+          if (count != 4) {
+            error = "expected one number";
+            break;
+          }
+          char *end;
+          errno = 0;
+          long number = strtol(words[3], &end, 0);
+          if (end == words[3] || *end || errno == ERANGE
+              || number < INT32_MIN || number > INT32_MAX)
+            error = "expected one number";
+          else binding->arg.i32 = number;
+          break;
+        }
+        case CONFIG_ARG_ARGV:
+          if (count < 4) {
+            error = "expected a command line";
+            break;
+          }
+          binding->arg.argv = &config->words[num_words];
+          for (uint32_t i = 3; i < count; i++)
+            config->words[num_words++] = words[i];
+          config->words[num_words++] = NULL;
+          break;
+      }
+    }
+    if (error) {
+      LOG_WARNING("%s:%u: %s", path, line_number, error);
+      config_file_free(config);
+      return false;
+    }
+    config->num_bindings++;
+  }
+  return true;
+}
+void config_file_free(config_t *config) {
+  free(config->bindings);
+  free(config->rules);
+  free(config->words);
+  free(config->text);
+  *config = (config_t){ 0 };
+}
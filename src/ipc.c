@@ -0,0 +1,434 @@
+/* Implements ipc.h */
+#include <ipc.h>
+
+/* Includes */
+#include <errno.h>      /* For errno */
+#include <fcntl.h>      /* For fcntl() */
+#include <stdio.h>      /* For snprintf() */
+#include <stdlib.h>     /* For getenv(), strtol() */
+#include <string.h>     /* For memcpy(), memmove(), strcmp(), strerror() */
+#include <unistd.h>     /* For read(), write(), close(), unlink(), getuid() */
+#include <sys/socket.h> /* For socket(), bind(), listen(), accept() */
+#include <sys/stat.h>   /* For lstat(), umask() */
+#include <sys/un.h>     /* For sockaddr_un */
+#include <logging.h>
+#include <loop.h>
+
+/* Constants */
+#define IPC_BUFFER_SIZE 65536 /* Per client, each way */
+#define IPC_MAGIC_LENGTH 4
+#define IPC_POOL_CHUNK 4 /* Clients allocated at a time */
+static const char *IPC_OP_NAMES[] = {
+  [IPC_OP_QUIT] = "quit",
+  [IPC_OP_DESTROY] = "destroy",
+  [IPC_OP_SPAWN] = "spawn",
+  [IPC_OP_MOVE] = "move",
+  [IPC_OP_TILE] = "tile",
+  [IPC_OP_CLIENTS] = "clients",
+  [IPC_OP_SUBSCRIBE] = "subscribe",
+  [IPC_OP_EVENT] = "event",
+  [IPC_OP_STATS] = "stats",
+  [IPC_OP_RELOAD] = "reload",
+  [IPC_OP_VIEW] = "view",
+  [IPC_OP_SEND] = "send",
+  [IPC_OP_BAR] = "bar",
+  [IPC_OP_RESTART] = "restart",
+};
+/* Clients have these numbers built in, renumbering them breaks every one */
+_Static_assert(
+    IPC_OP_QUIT == 0 && IPC_OP_SUBSCRIBE == 6 && IPC_OP_EVENT == 7
+      && IPC_OP_STATS == 8 && IPC_OP_RESTART == 13 && NUM_IPC_OPS == 14,
+    "IPC op values are part of the protocol"
+);
+_Static_assert(
+    sizeof(IPC_OP_NAMES)/sizeof(IPC_OP_NAMES[0]) == NUM_IPC_OPS,
+    "Every IPC op needs a name"
+);
+static const char *IPC_EVENT_NAMES[] = { "map", "unmap", "focus" };
+#define NUM_IPC_EVENTS (sizeof(IPC_EVENT_NAMES)/sizeof(IPC_EVENT_NAMES[0]))
+
+/* Client */
+struct ipc_client {
+  int fd;
+  uint32_t index; /* In ipc_pool */
+  bool decided;   /* Whether the mode is known yet */
+  bool binary;
+  uint32_t events;
+  struct ipc_client *next;
+  uint32_t in_length;
+  uint32_t out_length;
+  char in[IPC_BUFFER_SIZE];
+  char out[IPC_BUFFER_SIZE];
+};
+
+/* State */
+static int ipc_fd = -1;
+static char ipc_path[108] = { 0 };
+static ipc_handler_t ipc_handler = NULL;
+static ipc_client_t *ipc_clients = NULL;
+/* Buffers are too big to malloc() per connection without going to mmap() */
+static pool_t ipc_pool = {
+  .record_size = sizeof(ipc_client_t), .chunk_records = IPC_POOL_CHUNK
+};
+
+/* Connections */
+static void ipc_close(ipc_client_t *client) {
+  for (ipc_client_t **link = &ipc_clients; *link; link = &(*link)->next) {
+    if (*link == client) {
+      *link = client->next;
+      break;
+    }
+  }
+  loop_unwatch(client->fd);
+  close(client->fd);
+  pool_release(&ipc_pool, client, client->index);
+}
+static void ipc_send(ipc_client_t *client) {
+  uint32_t written = 0;
+  while (written < client->out_length) {
+    ssize_t result = send(
+        client->fd, client->out + written, client->out_length - written,
+        MSG_NOSIGNAL
+    );
+    if (result < 0) {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        ipc_close(client);
+        return;
+      }
+      break;
+    }
+    written += result;
+  }
+  memmove(client->out, client->out + written, client->out_length - written);
+  client->out_length -= written;
+  /* Only wait for the socket to be writable while there's a backlog */
+  loop_modify(client->fd, client->out_length ? EPOLLIN | EPOLLOUT : EPOLLIN);
+}
+static bool ipc_write(ipc_client_t *client, const void *data, uint32_t length) {
+  /* A client that doesn't keep up gets dropped rather than stall the WM */
+  if (IPC_BUFFER_SIZE - client->out_length < length) {
+    LOG_WARNING("IPC client %d isn't reading, dropping it", client->fd);
+    ipc_close(client);
+    return false;
+  }
+  memcpy(client->out + client->out_length, data, length);
+  client->out_length += length;
+  return true;
+}
+
+/* Decoding */
+static bool ipc_move_valid(const int32_t values[4]) {
+  /* X places windows in 16 bits and sizes them in 16 bits, from 1 */
+  return values[0] >= INT16_MIN && values[0] <= INT16_MAX
+    && values[1] >= INT16_MIN && values[1] <= INT16_MAX
+    && values[2] >= 1 && values[2] <= UINT16_MAX
+    && values[3] >= 1 && values[3] <= UINT16_MAX;
+}
+static bool ipc_decode_binary(
+    char *payload, uint32_t length, ipc_command_t *command
+) {
+  if (!length || (uint8_t)payload[0] >= NUM_IPC_OPS
+      || (uint8_t)payload[0] == IPC_OP_EVENT)
+    return false;
+  command->op = (uint8_t)payload[0];
+  payload++;
+  length--;
+  switch (command->op) {
+    case IPC_OP_DESTROY:
+    case IPC_OP_TILE:
+    case IPC_OP_SUBSCRIBE:
+      if (length < 4) return false;
+      memcpy(&command->window, payload, 4);
+      break;
+    case IPC_OP_VIEW:
+      if (length < 4) return false;
+      memcpy(command->values, payload, 4);
+      break;
+    case IPC_OP_SEND:
+      if (length < 8) return false;
+      memcpy(&command->window, payload, 4);
+      memcpy(command->values, payload + 4, 4);
+      break;
+    case IPC_OP_MOVE:
+      if (length < 20) return false;
+      memcpy(&command->window, payload, 4);
+      memcpy(command->values, payload + 4, 16);
+      if (!ipc_move_valid(command->values)) return false;
+      break;
+    case IPC_OP_SPAWN:
+    case IPC_OP_BAR:
+      /* The strings stay in the input buffer for the length of the call */
+      for (uint32_t i = 0; i < length && command->argc < IPC_MAX_ARGS;) {
+        command->argv[command->argc++] = payload + i;
+        while (i < length && payload[i]) i++;
+        if (i == length) return false;
+        i++;
+      }
+      break;
+    default:
+      break;
+  }
+  return (command->op != IPC_OP_SPAWN && command->op != IPC_OP_BAR)
+    || command->argc;
+}
+static bool ipc_decode_text(char *line, ipc_command_t *command) {
+  char *words[IPC_MAX_ARGS + 1];
+  uint32_t num_words = 0;
+  for (char *word = strtok(line, " \t"); word && num_words <= IPC_MAX_ARGS;
+      word = strtok(NULL, " \t"))
+    words[num_words++] = word;
+  if (!num_words) return false;
+
+  uint32_t op = 0;
+  while (op < NUM_IPC_OPS && strcmp(words[0], IPC_OP_NAMES[op])) op++;
+  if (op == NUM_IPC_OPS || op == IPC_OP_EVENT) return false;
+  command->op = op;
+  switch (command->op) {
+    case IPC_OP_DESTROY:
+    case IPC_OP_TILE:
+      if (num_words > 1) command->window = strtoul(words[1], NULL, 0);
+      break;
+    case IPC_OP_VIEW:
+      if (num_words < 2) return false;
+      command->values[0] = strtol(words[1], NULL, 0);
+      break;
+    case IPC_OP_SEND:
+      if (num_words < 3) return false;
+      command->window = strtoul(words[1], NULL, 0);
+      command->values[0] = strtol(words[2], NULL, 0);
+      break;
+    case IPC_OP_MOVE:
+      if (num_words < 6) return false;
+      command->window = strtoul(words[1], NULL, 0);
+      for (uint32_t i = 0; i < 4; i++) {
+        char *end;
+        errno = 0;
+        long value = strtol(words[i + 2], &end, 0);
+        if (end == words[i + 2] || *end || errno == ERANGE
+            || value < INT32_MIN || value > INT32_MAX)
+          return false;
+        command->values[i] = value;
+      }
+      if (!ipc_move_valid(command->values)) return false;
+      break;
+    case IPC_OP_SPAWN:
+    case IPC_OP_BAR:
+      for (uint32_t i = 1; i < num_words; i++)
+        command->argv[command->argc++] = words[i];
+      if (!command->argc) return false;
+      break;
+    case IPC_OP_SUBSCRIBE:
+      /* The window field carries the event mask */
+      for (uint32_t i = 1; i < num_words; i++)
+        for (uint32_t j = 0; j < NUM_IPC_EVENTS; j++)
+          if (!strcmp(words[i], IPC_EVENT_NAMES[j])) command->window |= 1 << j;
+      break;
+    default:
+      break;
+  }
+  return true;
+}
+static bool ipc_alive(const ipc_client_t *client) {
+  for (const ipc_client_t *check = ipc_clients; check; check = check->next)
+    if (check == client) return true;
+  return false;
+}
+/* Returns whether the client survived the command */
+static bool ipc_run(ipc_client_t *client, ipc_command_t *command) {
+  command->argv[command->argc] = NULL;
+  if (command->op == IPC_OP_SUBSCRIBE) client->events = command->window;
+  else ipc_handler(client, command);
+  return ipc_alive(client);
+}
+
+/* Reading */
+static void ipc_parse(ipc_client_t *client) {
+  uint32_t used = 0;
+  if (!client->decided) {
+    if (client->in_length < IPC_MAGIC_LENGTH
+        && !memcmp(client->in, IPC_MAGIC, client->in_length))
+      return;
+    client->decided = true;
+    client->binary = client->in_length >= IPC_MAGIC_LENGTH
+      && !memcmp(client->in, IPC_MAGIC, IPC_MAGIC_LENGTH);
+    if (client->binary) used = IPC_MAGIC_LENGTH;
+  }
+  for (;;) {
+    ipc_command_t command = { 0 };
+    char *start = client->in + used;
+    uint32_t available = client->in_length - used;
+    if (client->binary) {
+      uint32_t length;
+      if (available < 4) break;
+      memcpy(&length, start, 4);
+      if (length > IPC_BUFFER_SIZE - 4) {
+        ipc_close(client);
+        return;
+      }
+      if (available - 4 < length) break;
+      used += 4 + length;
+      if (ipc_decode_binary(start + 4, length, &command)
+          && !ipc_run(client, &command))
+        return;
+    } else {
+      char *end = memchr(start, '\n', available);
+      if (!end) break;
+      *end = '\0';
+      used += end - start + 1;
+      if (ipc_decode_text(start, &command) && !ipc_run(client, &command))
+        return;
+    }
+  }
+  memmove(client->in, client->in + used, client->in_length - used);
+  client->in_length -= used;
+  /* A message that can never fit would wedge the connection */
+  if (client->in_length == IPC_BUFFER_SIZE) ipc_close(client);
+}
+static void ipc_handle_client(int fd, uint32_t events, void *data) {
+  ipc_client_t *client = data;
+  if (events & EPOLLOUT) ipc_send(client);
+  if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR)) || !ipc_alive(client)) return;
+  for (;;) {
+    ssize_t result = read(
+        fd, client->in + client->in_length,
+        IPC_BUFFER_SIZE - client->in_length
+    );
+    if (result < 0 && errno == EINTR) continue;
+    if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+    if (result <= 0) {
+      ipc_close(client);
+      return;
+    }
+    client->in_length += result;
+    /* Handlers may close the client */
+    ipc_parse(client);
+    if (!ipc_alive(client)) return;
+  }
+}
+static void ipc_handle_listener(int fd, uint32_t events, void *data) {
+  for (;;) {
+    int client_fd = accept(fd, NULL, NULL);
+    if (client_fd < 0) return;
+    fcntl(client_fd, F_SETFL, O_NONBLOCK);
+    fcntl(client_fd, F_SETFD, FD_CLOEXEC);
+    uint32_t index;
+    ipc_client_t *client = pool_alloc(&ipc_pool, &index);
+    if (!client) {
+      close(client_fd);
+      continue;
+    }
+    client->fd = client_fd;
+    client->index = index;
+    if (!loop_watch(client_fd, EPOLLIN, ipc_handle_client, client)) {
+      close(client_fd);
+      pool_release(&ipc_pool, client, index);
+      continue;
+    }
+    client->next = ipc_clients;
+    ipc_clients = client;
+  }
+}
+
+/* Default socket path */
+void ipc_socket_path(char *path, size_t size) {
+  const char *socket = getenv("PWM_SOCKET");
+  if (socket) {
+    snprintf(path, size, "%s", socket);
+    return;
+  }
+  const char *display = getenv("DISPLAY");
+  const char *runtime = getenv("XDG_RUNTIME_DIR");
+  char name[64];
+  snprintf(name, sizeof(name), "%s", display ? display : ":0");
+  for (char *c = name; *c; c++) if (*c == '/') *c = '_';
+  if (runtime)
+    snprintf(path, size, "%s/pwm-%s.sock", runtime, name);
+  else
+    snprintf(path, size, "/tmp/pwm-%d-%s.sock", (int)getuid(), name);
+}
+
+/* Listening */
+bool ipc_init(const char *path, ipc_handler_t handler) {
+  struct sockaddr_un address = { .sun_family = AF_UNIX };
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    LOG_WARNING("IPC socket path is too long: %s", path);
+    return false;
+  }
+  strcpy(address.sun_path, path);
+  ipc_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (ipc_fd < 0) {
+    LOG_WARNING("Failed to create IPC socket (%s)", strerror(errno));
+    return false;
+  }
+  /*
+   * The path may be in /tmp, where anyone can leave something, so only a
+   * socket of this user's is replaced. Anyone who can connect can spawn
+   * commands, so it's created for this user only
+   */
+  struct stat info;
+  if (lstat(path, &info) == 0) {
+    if (!S_ISSOCK(info.st_mode) || info.st_uid != getuid()) {
+      LOG_WARNING("Not replacing %s, it isn't a socket of this user's", path);
+      close(ipc_fd);
+      ipc_fd = -1;
+      return false;
+    }
+    unlink(path);
+  }
+  mode_t mask = umask(0177);
+  int bound = bind(ipc_fd, (struct sockaddr *)&address, sizeof(address));
+  umask(mask);
+  if (bound < 0 || listen(ipc_fd, 16) < 0
+      || !loop_watch(ipc_fd, EPOLLIN, ipc_handle_listener, NULL)) {
+    LOG_WARNING("Failed to listen on %s (%s)", path, strerror(errno));
+    close(ipc_fd);
+    ipc_fd = -1;
+    return false;
+  }
+  strcpy(ipc_path, path);
+  ipc_handler = handler;
+  LOG_INFO("Listening on %s", path);
+  return true;
+}
+void ipc_cleanup(void) {
+  while (ipc_clients) ipc_close(ipc_clients);
+  pool_free(&ipc_pool);
+  if (ipc_fd < 0) return;
+  loop_unwatch(ipc_fd);
+  close(ipc_fd);
+  unlink(ipc_path);
+  ipc_fd = -1;
+}
+
+/* Counters */
+const pool_t *ipc_client_pool(void) {
+  return &ipc_pool;
+}
+
+/* Replying */
+bool ipc_binary(const ipc_client_t *client) {
+  return client->binary;
+}
+bool ipc_reply(ipc_client_t *client, const void *data, uint32_t length) {
+  if (client->binary && !ipc_write(client, &length, 4)) return false;
+  return ipc_write(client, data, length);
+}
+void ipc_publish(
+    ipc_event_t event, const void *data, uint32_t length, const char *text
+) {
+  ipc_client_t *next;
+  for (ipc_client_t *client = ipc_clients; client; client = next) {
+    next = client->next;
+    if (!(client->events & event)) continue;
+    if (client->binary) ipc_reply(client, data, length);
+    else ipc_reply(client, text, strlen(text));
+  }
+}
+void ipc_flush(void) {
+  ipc_client_t *next;
+  for (ipc_client_t *client = ipc_clients; client; client = next) {
+    next = client->next;
+    if (client->out_length) ipc_send(client);
+  }
+}
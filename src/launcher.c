@@ -0,0 +1,65 @@
+/* Implements launcher.h */
+#include <launcher.h>
+
+/* Includes */
+#include <fcntl.h>    /* For O_WRONLY */
+#include <signal.h>   /* For sigset_t */
+#include <spawn.h>    /* For posix_spawnp() */
+#include <string.h>   /* For strerror() */
+#include <sys/wait.h> /* For waitpid() */
+#include <unistd.h>   /* For STDOUT_FILENO, STDERR_FILENO */
+#include <logging.h>
+
+/* Environment */
+extern char **environ;
+
+/* Reap anything left over from before an exec */
+void launcher_init(void) {
+  launcher_reap();
+}
+
+/* Start a program */
+pid_t launcher_spawn(char *const argv[]) {
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(
+      &actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0
+  );
+  posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+
+  /*
+   * Children start with nothing blocked and default handlers, whatever the WM
+   * has set up for itself, in their own process group
+   */
+  posix_spawnattr_t attributes;
+  posix_spawnattr_init(&attributes);
+  sigset_t mask;
+  sigemptyset(&mask);
+  posix_spawnattr_setsigmask(&attributes, &mask);
+  sigset_t defaults;
+  sigemptyset(&defaults);
+  sigaddset(&defaults, SIGCHLD);
+  sigaddset(&defaults, SIGPIPE);
+  posix_spawnattr_setsigdefault(&attributes, &defaults);
+  posix_spawnattr_setpgroup(&attributes, 0);
+  posix_spawnattr_setflags(
+      &attributes,
+      POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP
+  );
+
+  pid_t pid;
+  int error = posix_spawnp(&pid, argv[0], &actions, &attributes, argv, environ);
+  posix_spawnattr_destroy(&attributes);
+  posix_spawn_file_actions_destroy(&actions);
+  if (error) {
+    LOG_WARNING("Failed to spawn %s (%s)", argv[0], strerror(error));
+    return -1;
+  }
+  LOG_INFO("Spawned %s (%d)", argv[0], (int)pid);
+  return pid;
+}
+
+/* Reap every child that has exited */
+void launcher_reap(void) {
+  while (waitpid(-1, NULL, WNOHANG) > 0) { }
+}
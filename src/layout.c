@@ -0,0 +1,89 @@
+/* Implements layout.h */
+#include <layout.h>
+
+/* Names */
+const char *const LAYOUT_NAMES[NUM_LAYOUTS] = {
+#define LAYOUT(name, ident) #ident,
+  LAYOUTS
+#undef LAYOUT
+};
+
+/* Rectangle comparison */
+int rect_equal(rect_t a, rect_t b) {
+  return a.x == b.x && a.y == b.y
+    && a.width == b.width && a.height == b.height;
+}
+
+/* Dispatch */
+void layout_apply(
+    layout_t layout, rect_t area, uint32_t num_windows, rect_t *rects
+) {
+  switch (layout) {
+#define LAYOUT(name, ident)\
+    case LAYOUT_##name:\
+      layout_##ident(area, num_windows, rects);\
+      break;
+    LAYOUTS
+#undef LAYOUT
+    default:
+      layout_tile(area, num_windows, rects);
+      break;
+  }
+}
+
+/* Master/stack tiling */
+void layout_tile(rect_t area, uint32_t num_windows, rect_t *rects) {
+  if (!num_windows) return;
+  if (num_windows == 1) {
+    rects[0] = area;
+    return;
+  }
+  uint16_t master_width = area.width/2;
+  rects[0] = (rect_t){ area.x, area.y, master_width, area.height };
+  /* Spread the rounding over the stack rather than leaving a gap */
+  uint32_t num_stack = num_windows - 1;
+  for (uint32_t i = 0; i < num_stack; i++) {
+    uint32_t top = i*area.height/num_stack;
+    uint32_t bottom = (i + 1)*area.height/num_stack;
+    rects[i + 1] = (rect_t){
+      area.x + master_width, area.y + top,
+      area.width - master_width, bottom - top
+    };
+  }
+}
+
+/* Monocle */
+void layout_monocle(rect_t area, uint32_t num_windows, rect_t *rects) {
+  for (uint32_t i = 0; i < num_windows; i++) rects[i] = area;
+}
+
+/* Grid */
+void layout_grid(rect_t area, uint32_t num_windows, rect_t *rects) {
+  if (!num_windows) return;
+  uint32_t num_columns = 1;
+  while (num_columns*num_columns < num_windows) num_columns++;
+  uint32_t num_rows = (num_windows + num_columns - 1)/num_columns;
+  uint32_t i = 0;
+  for (uint32_t row = 0; row < num_rows; row++) {
+    uint32_t top = row*area.height/num_rows;
+    uint32_t bottom = (row + 1)*area.height/num_rows;
+    uint32_t in_row = num_windows - i < num_columns
+      ? num_windows - i : num_columns;
+    for (uint32_t column = 0; column < in_row; column++, i++) {
+      uint32_t left = column*area.width/in_row;
+      uint32_t right = (column + 1)*area.width/in_row;
+      rects[i] = (rect_t){
+        area.x + left, area.y + top, right - left, bottom - top
+      };
+    }
+  }
+}
+
+/* Columns */
+void layout_columns(rect_t area, uint32_t num_windows, rect_t *rects) {
+  for (uint32_t i = 0; i < num_windows; i++) {
+    uint32_t left = i*area.width/num_windows;
+    uint32_t right = (i + 1)*area.width/num_windows;
+    rects[i] = (rect_t){ area.x + left, area.y, right - left, area.height };
+  }
+}
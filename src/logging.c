@@ -2,9 +2,17 @@
 #include <logging.h>
 
 /* Includes */
-#include <stdarg.h> /* For va_list */
-#include <stdio.h>  /* For fprintf(), vfprintf() */
-#include <stdlib.h> /* For abort() */
+#include <stdarg.h>    /* For va_list */
+#include <stdbool.h>   /* For booleans */
+#include <stdint.h>    /* For uint_fast64_t */
+#include <stdio.h>     /* For snprintf(), vsnprintf() */
+#include <stdlib.h>    /* For abort(), getenv() */
+#include <string.h>    /* For memcpy(), strcmp() */
+#include <errno.h>     /* For errno */
+#include <unistd.h>    /* For write(), getpid() */
+#include <stdatomic.h> /* For the ring buffer's indices */
+#include <pthread.h>   /* For the writer thread */
+#include <semaphore.h> /* For waking the writer thread */
 
 /* Constants */
 const char *LOG_LEVELS[] = {
@@ -20,16 +28,144 @@ const char *LOG_LEVELS[] = {
 #undef ADD_LEVEL
 #endif
 };
+#define LOG_MESSAGE_SIZE 512 /* Longer messages are truncated */
+
+/* Runtime level */
+log_level_t log_level = LOG_LEVEL_INFO;
+
+#if ASYNC_LOGS
+/*
+ * Ring buffer with a single producer (the event thread) and a single consumer
+ * (the writer thread). The indices only ever grow, and are masked on access
+ */
+_Static_assert(
+    (LOG_BUFFER_SIZE & (LOG_BUFFER_SIZE - 1)) == 0,
+    "LOG_BUFFER_SIZE must be a power of two"
+);
+static char log_buffer[LOG_BUFFER_SIZE];
+static atomic_size_t log_head = 0; /* Only written by the event thread */
+static atomic_size_t log_tail = 0; /* Only written by the writer thread */
+static atomic_uint_fast64_t log_dropped = 0;
+static atomic_bool log_running = false;
+static sem_t log_ready;
+static pthread_t log_thread;
+static pid_t log_pid = 0;
+
+/* Write everything queued so far, then report any drops */
+static void log_drain(void) {
+  size_t tail = atomic_load_explicit(&log_tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&log_head, memory_order_acquire);
+  while (tail != head) {
+    size_t start = tail & (LOG_BUFFER_SIZE - 1);
+    size_t length = head - tail;
+    if (length > LOG_BUFFER_SIZE - start) length = LOG_BUFFER_SIZE - start;
+    ssize_t written = write(STDOUT_FILENO, log_buffer + start, length);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      /* Nowhere to write to, so throw it away rather than spin */
+      written = head - tail;
+    }
+    tail += written;
+    atomic_store_explicit(&log_tail, tail, memory_order_release);
+    head = atomic_load_explicit(&log_head, memory_order_acquire);
+  }
+
+  uint_fast64_t dropped = atomic_exchange(&log_dropped, 0);
+  if (dropped) {
+    char message[LOG_MESSAGE_SIZE];
+    int length = snprintf(
+        message, sizeof(message), "%s%llu log messages dropped\n",
+        LOG_LEVELS[LOG_LEVEL_WARNING], (unsigned long long)dropped
+    );
+    if (write(STDOUT_FILENO, message, length) < 0) { }
+  }
+}
+static void *log_writer(void *arg) {
+  while (atomic_load(&log_running)) {
+    if (sem_wait(&log_ready) < 0) continue;
+    log_drain();
+  }
+  log_drain();
+  return NULL;
+}
+/* Queue a message for the writer, or drop it if there isn't room */
+static void log_push(const char *message, size_t length) {
+  size_t head = atomic_load_explicit(&log_head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&log_tail, memory_order_acquire);
+  if (LOG_BUFFER_SIZE - (head - tail) < length) {
+    atomic_fetch_add_explicit(&log_dropped, 1, memory_order_relaxed);
+    return;
+  }
+  size_t start = head & (LOG_BUFFER_SIZE - 1);
+  size_t first = length < LOG_BUFFER_SIZE - start
+    ? length : LOG_BUFFER_SIZE - start;
+  memcpy(log_buffer + start, message, first);
+  memcpy(log_buffer, message + first, length - first);
+  atomic_store_explicit(&log_head, head + length, memory_order_release);
+  sem_post(&log_ready);
+}
+#endif
+
+/* Read the runtime level and start the writer thread */
+void log_init(void) {
+  const char *level = getenv("PWM_LOG_LEVEL");
+  if (level) {
+    if (!strcmp(level, "info")) log_level = LOG_LEVEL_INFO;
+    else if (!strcmp(level, "warning")) log_level = LOG_LEVEL_WARNING;
+    else if (!strcmp(level, "error")) log_level = LOG_LEVEL_ERROR;
+  }
+#if LOGS && ASYNC_LOGS
+  if (sem_init(&log_ready, 0, 0) < 0) return;
+  atomic_store(&log_running, true);
+  if (pthread_create(&log_thread, NULL, log_writer, NULL)) {
+    atomic_store(&log_running, false);
+    sem_destroy(&log_ready);
+    return;
+  }
+  log_pid = getpid();
+#endif
+}
+
+/* Write out anything queued and stop the writer thread */
+void log_cleanup(void) {
+#if LOGS && ASYNC_LOGS
+  /* Forked children don't have the writer thread */
+  if (!atomic_load(&log_running) || getpid() != log_pid) return;
+  atomic_store(&log_running, false);
+  sem_post(&log_ready);
+  pthread_join(log_thread, NULL);
+  sem_destroy(&log_ready);
+#endif
+}
 
 /* Log to stdout */
 void log_msg(log_level_t level, const char *format, ...) {
 #if LOGS
-  fprintf(level == LOG_LEVEL_ERROR ? stderr : stdout, LOG_LEVELS[level]);
+  if (level < log_level && level != LOG_LEVEL_ERROR) return;
+  char message[LOG_MESSAGE_SIZE];
+  int length = snprintf(message, sizeof(message), "%s", LOG_LEVELS[level]);
   va_list args;
   va_start(args, format);
-  vfprintf(level == LOG_LEVEL_ERROR ? stderr : stdout, format, args);
+  length += vsnprintf(
+      message + length, sizeof(message) - length, format, args
+  );
   va_end(args);
-  fprintf(level == LOG_LEVEL_ERROR ? stderr : stdout, "\n");
+  if (length > (int)sizeof(message) - 2) length = sizeof(message) - 2;
+  message[length++] = '\n';
+  message[length] = '\0';
+
+#if ASYNC_LOGS
+  if (level != LOG_LEVEL_ERROR && atomic_load(&log_running)) {
+    log_push(message, length);
+    return;
+  }
+  /* Let everything before an error reach the log before aborting */
+  if (level == LOG_LEVEL_ERROR) log_cleanup();
+#endif
+  if (write(
+        level == LOG_LEVEL_ERROR ? STDERR_FILENO : STDOUT_FILENO,
+        message, length
+  ) < 0) { }
   if (level == LOG_LEVEL_ERROR) abort();
 #endif
 }
@@ -0,0 +1,128 @@
+/* Implements loop.h */
+#include <loop.h>
+
+/* Includes */
+#include <errno.h>       /* For errno */
+#include <stdlib.h>      /* For realloc(), free() */
+#include <string.h>      /* For memset(), strerror() */
+#include <unistd.h>      /* For read(), close() */
+#include <sys/timerfd.h> /* For timerfd_create(), timerfd_settime() */
+#include <logging.h>
+
+/* Constants */
+#define LOOP_MAX_EVENTS 32 /* Ready file descriptors handled per wait */
+
+/* Watched file descriptors, indexed by the file descriptor itself */
+typedef struct {
+  loop_handler_t handler;
+  void *data;
+  bool timer;
+} loop_watch_t;
+static int loop_fd = -1;
+static loop_watch_t *loop_watches = NULL;
+static int loop_capacity = 0;
+
+/* Set up and tear down */
+void loop_init(void) {
+  loop_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (loop_fd < 0)
+    LOG_ERROR("Failed to create epoll instance (%s)", strerror(errno));
+}
+void loop_cleanup(void) {
+  for (int fd = 0; fd < loop_capacity; fd++)
+    if (loop_watches[fd].handler && loop_watches[fd].timer) close(fd);
+  free(loop_watches);
+  loop_watches = NULL;
+  loop_capacity = 0;
+  close(loop_fd);
+  loop_fd = -1;
+}
+
+/* Watching file descriptors */
+bool loop_watch(int fd, uint32_t events, loop_handler_t handler, void *data) {
+  if (fd >= loop_capacity) {
+    int capacity = loop_capacity ? loop_capacity : 16;
+    while (capacity <= fd) capacity *= 2;
+    loop_watch_t *watches =
+      realloc(loop_watches, sizeof(loop_watch_t)*capacity);
+    if (!watches) LOG_ERROR("Failed to allocate watches");
+    memset(
+        watches + loop_capacity, 0,
+        sizeof(loop_watch_t)*(capacity - loop_capacity)
+    );
+    loop_watches = watches;
+    loop_capacity = capacity;
+  }
+  struct epoll_event event = { .events = events, .data.fd = fd };
+  if (epoll_ctl(loop_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+    LOG_WARNING("Failed to watch file descriptor %d (%s)", fd, strerror(errno));
+    return false;
+  }
+  loop_watches[fd] = (loop_watch_t){ handler, data, false };
+  return true;
+}
+void loop_modify(int fd, uint32_t events) {
+  struct epoll_event event = { .events = events, .data.fd = fd };
+  if (epoll_ctl(loop_fd, EPOLL_CTL_MOD, fd, &event) < 0)
+    LOG_WARNING("Failed to modify file descriptor %d (%s)", fd, strerror(errno));
+}
+void loop_unwatch(int fd) {
+  if (fd < 0 || fd >= loop_capacity || !loop_watches[fd].handler) return;
+  epoll_ctl(loop_fd, EPOLL_CTL_DEL, fd, NULL);
+  loop_watches[fd] = (loop_watch_t){ NULL, NULL, false };
+}
+
+/* Timers */
+int loop_timer_add(loop_handler_t handler, void *data) {
+  int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timer < 0) {
+    LOG_WARNING("Failed to create timer (%s)", strerror(errno));
+    return -1;
+  }
+  if (!loop_watch(timer, EPOLLIN, handler, data)) {
+    close(timer);
+    return -1;
+  }
+  loop_watches[timer].timer = true;
+  return timer;
+}
+void loop_timer_arm(int timer, uint64_t delay_ns, uint64_t interval_ns) {
+  /* A zero delay would disarm the timer, so make it as short as possible */
+  if (!delay_ns) delay_ns = 1;
+  struct itimerspec spec = {
+    .it_value = { delay_ns/1000000000, delay_ns%1000000000 },
+    .it_interval = { interval_ns/1000000000, interval_ns%1000000000 }
+  };
+  timerfd_settime(timer, 0, &spec, NULL);
+}
+void loop_timer_disarm(int timer) {
+  struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+  timerfd_settime(timer, 0, &spec, NULL);
+}
+void loop_timer_remove(int timer) {
+  if (timer < 0) return;
+  loop_unwatch(timer);
+  close(timer);
+}
+
+/* Wait and run ready handlers */
+void loop_wait(int timeout) {
+  struct epoll_event events[LOOP_MAX_EVENTS];
+  int num_events = epoll_wait(loop_fd, events, LOOP_MAX_EVENTS, timeout);
+  if (num_events < 0) {
+    if (errno != EINTR)
+      LOG_ERROR("Failed to wait for events (%s)", strerror(errno));
+    return;
+  }
+  for (int i = 0; i < num_events; i++) {
+    int fd = events[i].data.fd;
+    /* An earlier handler may have stopped watching this one */
+    if (fd >= loop_capacity || !loop_watches[fd].handler) continue;
+    loop_watch_t watch = loop_watches[fd];
+    if (watch.timer) {
+      uint64_t expirations;
+      if (read(fd, &expirations, sizeof(expirations)) < 0) continue;
+    }
+    watch.handler(fd, events[i].events, watch.data);
+  }
+}
@@ -3,15 +3,30 @@
 
 /* Entry point */
 int main(int argc, char *argv[]) {
+  if (argc == 3 && !strcmp(argv[1], "--replay")) return replay(argv[2]);
+
   /* Setup */
+  setup_signals();
+  log_init();
+  arena_init(&pass_arena, PASS_ARENA_SIZE);
+  setup_trace();
+  launcher_init();
+  loop_init();
   connection = get_connection();
   setup = get_setup();
   screen = get_screen();
   root = get_root();
   log_setup_info();
   /* Get atoms */
-  WM_PROTOCOLS = get_atom("WM_PROTOCOLS");
-  WM_DELETE_WINDOW = get_atom("WM_DELETE_WINDOW");
+  get_atoms();
+  /* Drawing, before the outputs that get a bar each */
+  setup_render();
+  setup_bar();
+  /* Outputs */
+  setup_randr();
+  update_outputs();
+  /* Announce pwm to EWMH clients */
+  setup_ewmh();
   /* Set root event mask */
   set_event_mask(
       root,
@@ -23,20 +38,52 @@ int main(int argc, char *argv[]) {
   );
   /* Keyboard setup */
   xkb_context = create_xkb_context();
+  setup_xkb_extension();
   xkb_keymap = create_xkb_keymap();
   xkb_state = create_xkb_state();
-  for (uint32_t i = 0; i < NUM_KEYMAPS; i++)
-    grab_keymap(_KEYMAPS[i].modifiers, _KEYMAPS[i].keysym);
+  select_xkb_events();
+  setup_config();
+  update_modifier_keys();
+  setup_drag();
+  /* Windows that were there before pwm, where the last one left them */
+  if (!restore_snapshot()) adopt_windows();
+  setup_snapshot();
+  /* Control socket */
+  if (IPC) setup_ipc();
 
   /* Event loop */
+  loop_watch(
+      xcb_get_file_descriptor(connection), EPOLLIN, handle_connection_fd, NULL
+  );
+  loop_watch(signal_fd, EPOLLIN, handle_signal_fd, NULL);
   running = true;
+  xcb_flush(connection);
   while (running) eventloop();
 
   /* Cleanup */
+  if (restarting) keep_frames();
+  update_snapshot();
+  snapshot_close();
+  render_cleanup();
+  ipc_cleanup();
+  cleanup_config();
+  cleanup_ewmh();
+  client_cleanup();
+  arena_free(&pass_arena);
   unref_xkb_state();
   unref_xkb_keymap();
   unref_xkb_context();
+  loop_cleanup();
+  close(signal_fd);
   disconnect();
+  trace_close();
+  log_cleanup();
+  /* Started again the same way, as whatever pwm is there now */
+  if (restarting) {
+    execvp(argv[0], argv);
+    fprintf(stderr, "Failed to restart %s (%s)\n", argv[0], strerror(errno));
+    return 1;
+  }
   return 0;
 }
 
@@ -46,128 +93,2113 @@ static xcb_connection_t *get_connection(void) {
   int error = xcb_connection_has_error(_connection);
   if (error) {
     xcb_disconnect(_connection);
-    log_msg(LOG_LEVEL_ERROR, "Failed to connect to X server (%d)", error);
+    LOG_ERROR("Failed to connect to X server (%d)", error);
+  }
+  return _connection;
+}
+
+static void disconnect(void) {
+  xcb_disconnect(connection);
+}
+static const xcb_setup_t *get_setup(void) {
+  const xcb_setup_t *_setup =  xcb_get_setup(connection);
+  if (!_setup)
+    LOG_ERROR("Failed to get setup information");
+  return _setup;
+}
+static xcb_screen_t *get_screen(void) {
+  /* This gets the first screen blindly (not good for several monitors) */
+  xcb_screen_iterator_t screen_iterator = xcb_setup_roots_iterator(setup);
+  xcb_screen_t *_screen = screen_iterator.data;
+  if (!_screen)
+    LOG_ERROR("Failed to get first screen");
+  return _screen;
+}
+static xcb_window_t get_root(void) {
+  return screen->root;
+}
+static void get_atoms(void) {
+  /* Send every request before reading any reply, so this is one round trip */
+  xcb_intern_atom_cookie_t cookies[NUM_ATOMS];
+  for (uint32_t i = 0; i < NUM_ATOMS; i++)
+    cookies[i] = xcb_intern_atom(
+        connection, 0, strlen(ATOM_TABLE[i].name), ATOM_TABLE[i].name
+    );
+
+  STATS_ROUND_TRIP();
+  for (uint32_t i = 0; i < NUM_ATOMS; i++) {
+    const char *name = ATOM_TABLE[i].name;
+    xcb_generic_error_t *error = NULL;
+    xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(
+        connection, cookies[i], &error
+    );
+    if (!reply) {
+      if (error)
+        LOG_ERROR(
+            "Failed to get atom: %s (%d)", name, error->error_code
+        );
+      else
+        LOG_ERROR("Failed to get atom: %s", name);
+    }
+    xcb_atom_t atom = reply->atom;
+    free(reply);
+    if (!atom)
+      LOG_ERROR("Failed to get atom: %s", name);
+    else
+      LOG_INFO("Got atom: %s", name);
+    *ATOM_TABLE[i].atom = atom;
+  }
+}
+static void log_setup_info(void) {
+  LOG_INFO(
+      "setup.protocol_major_version = %d",
+      setup->protocol_major_version
+  );
+  LOG_INFO(
+      "setup.protocol_minor_version = %d",
+      setup->protocol_minor_version
+  );
+  LOG_INFO(
+      "screen.width_in_millimeters = %d",
+      screen->width_in_millimeters
+  );
+  LOG_INFO(
+      "screen.height_in_millimeters = %d",
+      screen->height_in_millimeters
+  );
+  LOG_INFO(
+      "screen.width_in_pixels = %d",
+      screen->width_in_pixels
+  );
+  LOG_INFO(
+      "screen.height_in_pixels = %d",
+      screen->height_in_pixels
+  );
+}
+static void setup_randr(void) {
+  const xcb_query_extension_reply_t *randr =
+    xcb_get_extension_data(connection, &xcb_randr_id);
+  if (!randr || !randr->present) {
+    LOG_WARNING("RandR isn't available, using the whole screen");
+    return;
+  }
+  randr_event_base = randr->first_event;
+  xcb_randr_select_input(
+      connection, root, XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE
+  );
+}
+static void update_outputs(void) {
+  outputs_outdated = false;
+  xcb_randr_crtc_t crtcs[MAX_OUTPUTS];
+  rect_t areas[MAX_OUTPUTS];
+  uint64_t frames[MAX_OUTPUTS];
+  uint32_t num_areas = 0;
+
+  if (randr_event_base) {
+    STATS_ROUND_TRIP();
+    xcb_randr_get_screen_resources_current_reply_t *resources =
+      xcb_randr_get_screen_resources_current_reply(
+          connection,
+          xcb_randr_get_screen_resources_current(connection, root),
+          NULL
+      );
+    if (resources) {
+      /* Ask about every CRTC before reading any reply */
+      xcb_randr_crtc_t *all_crtcs =
+        xcb_randr_get_screen_resources_current_crtcs(resources);
+      int num_crtcs =
+        xcb_randr_get_screen_resources_current_crtcs_length(resources);
+      const xcb_randr_mode_info_t *modes =
+        xcb_randr_get_screen_resources_current_modes(resources);
+      int num_modes =
+        xcb_randr_get_screen_resources_current_modes_length(resources);
+      if (num_crtcs > MAX_OUTPUTS) num_crtcs = MAX_OUTPUTS;
+      xcb_randr_get_crtc_info_cookie_t cookies[MAX_OUTPUTS];
+      for (int i = 0; i < num_crtcs; i++)
+        cookies[i] = xcb_randr_get_crtc_info(
+            connection, all_crtcs[i], resources->config_timestamp
+        );
+      STATS_ROUND_TRIP();
+      for (int i = 0; i < num_crtcs; i++) {
+        xcb_randr_get_crtc_info_reply_t *info =
+          xcb_randr_get_crtc_info_reply(connection, cookies[i], NULL);
+        if (!info) continue;
+        rect_t area = { info->x, info->y, info->width, info->height };
+        bool active = info->mode && info->width && info->height;
+        uint64_t frame_ns = get_frame_ns(modes, num_modes, info->mode);
+        free(info);
+        if (!active) continue;
+        /* Mirrored CRTCs share one output */
+        bool mirrored = false;
+        for (uint32_t j = 0; j < num_areas; j++)
+          if (rect_equal(areas[j], area)) mirrored = true;
+        if (mirrored) continue;
+        crtcs[num_areas] = all_crtcs[i];
+        frames[num_areas] = frame_ns;
+        areas[num_areas++] = area;
+      }
+      free(resources);
+    }
+  }
+  if (!num_areas) {
+    crtcs[0] = 0;
+    areas[0] = (rect_t){
+      0, 0, screen->width_in_pixels, screen->height_in_pixels
+    };
+    frames[0] = DEFAULT_FRAME_NS;
+    num_areas = 1;
+  }
+
+  /* Only outputs that are new or changed need laying out again */
+  for (uint32_t j = 0; j < num_areas; j++) {
+    uint32_t i = 0;
+    while (i < num_outputs && outputs[i].crtc != crtcs[j]) i++;
+    if (i == num_outputs) {
+      if (num_outputs < MAX_OUTPUTS) i = add_output(crtcs[j], areas[j]);
+      else continue;
+    }
+    outputs[i].frame_ns = frames[j];
+    if (!rect_equal(outputs[i].area, areas[j])) {
+      outputs[i].area = areas[j];
+      for (uint32_t w = 0; w < WORKSPACES; w++) mark_workspace(i, w);
+    }
+  }
+  /*
+   * Outputs that are gone hand their clients to the first output. Going
+   * backwards, clients only pass through removed outputs until they reach one
+   * that's staying
+   */
+  for (uint32_t i = num_outputs; i-- > 0;) {
+    bool found = false;
+    for (uint32_t j = 0; j < num_areas; j++)
+      if (outputs[i].crtc == crtcs[j]) found = true;
+    if (!found) remove_output(i);
+  }
+  if (current_output >= num_outputs) current_output = 0;
+  update_output_bars();
+}
+static uint64_t get_frame_ns(
+    const xcb_randr_mode_info_t *modes, int num_modes, xcb_randr_mode_t mode
+) {
+  for (int i = 0; i < num_modes; i++) {
+    if (modes[i].id != mode) continue;
+    uint64_t lines = modes[i].vtotal;
+    if (modes[i].mode_flags & XCB_RANDR_MODE_FLAG_DOUBLE_SCAN) lines *= 2;
+    if (modes[i].mode_flags & XCB_RANDR_MODE_FLAG_INTERLACE) lines /= 2;
+    if (!modes[i].dot_clock || !modes[i].htotal || !lines) break;
+    return modes[i].htotal*lines*1000000000ull/modes[i].dot_clock;
+  }
+  return DEFAULT_FRAME_NS;
+}
+static uint32_t add_output(xcb_randr_crtc_t crtc, rect_t area) {
+  uint32_t index = num_outputs++;
+  outputs[index] = (output_t){ .crtc = crtc, .area = area };
+  for (uint32_t w = 0; w < WORKSPACES; w++)
+    outputs[index].workspaces[w].layout = DEFAULT_LAYOUT;
+  LOG_INFO(
+      "Output %d: %dx%d+%d+%d",
+      (int)index, area.width, area.height, area.x, area.y
+  );
+  return index;
+}
+static void remove_output(uint32_t index) {
+  LOG_INFO("Output %d removed", (int)index);
+  destroy_bar(index);
+  /* Orphans move to the same workspace on the first output */
+  output_t orphans = outputs[index];
+  for (uint32_t i = index + 1; i < num_outputs; i++) {
+    outputs[i - 1] = outputs[i];
+    for (uint32_t w = 0; w < WORKSPACES; w++)
+      for (client_t *client = outputs[i - 1].workspaces[w].clients.head;
+          client; client = client->next)
+        client->output = i - 1;
+  }
+  num_outputs--;
+  if (current_output > index) current_output--;
+  for (uint32_t w = 0; w < WORKSPACES; w++) {
+    client_list_t *list = &orphans.workspaces[w].clients;
+    while (list->head) {
+      client_t *client = list->head;
+      client_list_remove(list, client);
+      client_list_append(&outputs[0].workspaces[w].clients, client);
+      client->output = 0;
+      sync_client_visibility(client);
+    }
+    mark_workspace(0, w);
+  }
+}
+static uint32_t find_output(int16_t x, int16_t y) {
+  for (uint32_t o = 0; o < num_outputs; o++) {
+    rect_t area = outputs[o].area;
+    if (x >= area.x && y >= area.y
+        && x < area.x + area.width && y < area.y + area.height)
+      return o;
+  }
+  return current_output;
+}
+static void adopt_windows(void) {
+  STATS_ROUND_TRIP();
+  xcb_query_tree_reply_t *tree = xcb_query_tree_reply(
+      connection, xcb_query_tree(connection, root), NULL
+  );
+  if (!tree) {
+    LOG_WARNING("Failed to query existing windows");
+    return;
+  }
+  adopt_children(
+      xcb_query_tree_children(tree), xcb_query_tree_children_length(tree)
+  );
+  free(tree);
+}
+static void adopt_children(const xcb_window_t *children, int num_children) {
+  struct {
+    xcb_get_window_attributes_cookie_t attributes;
+    xcb_get_geometry_cookie_t geometry;
+    xcb_get_property_cookie_t state;
+  } *cookies = arena_alloc(&pass_arena, sizeof(*cookies)*num_children);
+  struct {
+    client_t *client;
+    rect_t rect;
+    bool iconic;
+  } *adopted = arena_alloc(&pass_arena, sizeof(*adopted)*num_children);
+
+  /* Ask about every window before reading any reply: one round trip */
+  for (int i = 0; i < num_children; i++) {
+    cookies[i].attributes = xcb_get_window_attributes(connection, children[i]);
+    cookies[i].geometry = xcb_get_geometry(connection, children[i]);
+    cookies[i].state = xcb_get_property(
+        connection, 0, children[i], WM_STATE, WM_STATE, 0, 2
+    );
+  }
+  STATS_ROUND_TRIP();
+  uint32_t num_adopted = 0;
+  for (int i = 0; i < num_children; i++) {
+    /* Every reply gets read, so none are left queued in XCB */
+    xcb_get_window_attributes_reply_t *attributes =
+      xcb_get_window_attributes_reply(connection, cookies[i].attributes, NULL);
+    xcb_get_geometry_reply_t *geometry =
+      xcb_get_geometry_reply(connection, cookies[i].geometry, NULL);
+    xcb_get_property_reply_t *state =
+      xcb_get_property_reply(connection, cookies[i].state, NULL);
+    uint32_t wm_state = XCB_ICCCM_WM_STATE_WITHDRAWN;
+    if (state && state->format == 32 && xcb_get_property_value_length(state))
+      wm_state = *(uint32_t *)xcb_get_property_value(state);
+
+    /*
+     * Managed windows are the ones on screen, plus iconic ones, since there's
+     * no other way to get those back. Windows that vanished have no replies
+     */
+    bool adopt = attributes && geometry
+      && !attributes->override_redirect
+      && attributes->_class != XCB_WINDOW_CLASS_INPUT_ONLY
+      && (attributes->map_state == XCB_MAP_STATE_VIEWABLE
+        || wm_state == XCB_ICCCM_WM_STATE_ICONIC);
+    if (adopt) {
+      adopted[num_adopted].client = manage_window(children[i]);
+      adopted[num_adopted].rect = (rect_t){
+        geometry->x, geometry->y,
+        geometry->width + 2*BORDER_WIDTH, geometry->height + 2*BORDER_WIDTH
+      };
+      adopted[num_adopted].iconic =
+        attributes->map_state != XCB_MAP_STATE_VIEWABLE;
+      num_adopted++;
+    }
+    free(attributes);
+    free(geometry);
+    free(state);
+  }
+
+  /* Managing them asked for their properties, all read in one round trip */
+  if (fetching_clients) read_properties();
+  for (uint32_t i = 0; i < num_adopted; i++) {
+    client_t *client = adopted[i].client;
+    rect_t rect = adopted[i].rect;
+    client->floating = client->transient_for != XCB_NONE;
+    /*
+     * Iconic ones stay managed but unmapped, and Iconic, until they ask to be
+     * mapped again like any other window
+     */
+    if (adopted[i].iconic) continue;
+    attach_client(
+        client, find_output(rect.x + rect.width/2, rect.y + rect.height/2)
+    );
+    client->needs_map = true;
+    apply_rules(client);
+    /* Floating ones stay where they were */
+    if (client->floating) send_client_rect(client, rect);
+  }
+  LOG_INFO("Adopted %u of %d existing windows", num_adopted, num_children);
+}
+static void eventloop(void) {
+  /*
+   * Events XCB read off the socket while waiting on a reply never make its
+   * file descriptor readable, so handle those without sleeping
+   */
+  xcb_generic_event_t *queued = xcb_poll_for_queued_event(connection);
+  STATS_BEGIN();
+  if (queued) handle_xcb_events(queued);
+  loop_wait(queued ? 0 : -1);
+  finish_loop_pass();
+  STATS_END(STATS_LOOP);
+}
+static void finish_loop_pass(void) {
+  /* However many screen changes came in, only query outputs once */
+  if (outputs_outdated) update_outputs();
+  /* However many keymap notifies came in, only rebuild once */
+  if (xkb_keymap_outdated) update_xkb_keymap();
+  /* Between batches, so every event in one sees the same bindings */
+  if (config_outdated) reload_config();
+  /* Every fetch handlers asked for, so the layout sees the latest */
+  if (fetching_clients) read_properties();
+  /* Before the layout, which only sees the workspaces being shown */
+  if (workspaces_outdated) update_workspaces();
+  /* Likewise, lay out once for however many clients came and went */
+  if (layout_dirty) arrange();
+  /* After the layout, so newly mapped clients can take focus */
+  if (focus_outdated) update_focus();
+  /* Dragged windows move once a frame, however often the pointer did */
+  if (drag.pending && !drag.paced) update_drag();
+  if (dirty_decorations) update_decorations();
+  /* After everything it shows has settled for the pass */
+  if (bar_outdated) update_bar();
+  if (ewmh_outdated) update_ewmh();
+  /* Handlers only queue requests, send them all at once */
+  ipc_flush();
+  xcb_flush(connection);
+  arena_reset(&pass_arena);
+}
+static void setup_trace(void) {
+  const char *path = getenv("PWM_TRACE");
+  if (path) trace_open(path, TRACE_RECORDS);
+}
+static int replay(const char *path) {
+  log_init();
+  arena_init(&pass_arena, PASS_ARENA_SIZE);
+  trace_t trace;
+  if (!trace_load(path, &trace)) LOG_ERROR("Failed to load trace %s", path);
+  /* Windows in the trace belong to the server it was recorded on */
+  connection = replay_connect(1920, 1080);
+  setup = get_setup();
+  screen = get_screen();
+  root = get_root();
+  get_atoms();
+  setup_randr();
+  update_outputs();
+  running = true;
+
+  /* Batches are handled as they were recorded, as fast as possible */
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  xcb_generic_event_t *events[EVENT_BATCH_SIZE];
+  uint64_t num_batches = 0;
+  for (uint64_t i = 0; i < trace.count && running;) {
+    uint32_t batch = trace_get(&trace, i)->batch;
+    uint32_t num_events = 0;
+    for (; i < trace.count && num_events < EVENT_BATCH_SIZE
+        && trace_get(&trace, i)->batch == batch; i++) {
+      /*
+       * Handlers free events, so each gets its own copy, as big as one from
+       * xcb with the full sequence xcb adds after the wire event left zero
+       */
+      events[num_events] = calloc(1, sizeof(xcb_generic_event_t));
+      if (!events[num_events]) LOG_ERROR("Failed to allocate event");
+      memcpy(
+          events[num_events], trace_get(&trace, i)->event,
+          sizeof(trace_get(&trace, i)->event)
+      );
+      num_events++;
+    }
+    handle_event_batch(events, num_events);
+    finish_loop_pass();
+    num_batches++;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  cleanup_ewmh();
+  client_cleanup();
+  arena_free(&pass_arena);
+  disconnect();
+  /* Every request has reached the server once it's seen the disconnect */
+  replay_cleanup();
+
+  double seconds =
+    (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)/1e9;
+  fprintf(
+      stderr, "Replayed %llu events in %llu batches in %.3fs (%.0f/s),"
+      " %llu requests\n",
+      (unsigned long long)trace.count, (unsigned long long)num_batches,
+      seconds, seconds > 0 ? trace.count/seconds : 0,
+      (unsigned long long)replay_requests()
+  );
+  trace_unload(&trace);
+  log_cleanup();
+  return 0;
+}
+static void setup_signals(void) {
+  /* Blocked before any thread starts, so every thread inherits the mask */
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  sigaddset(&mask, SIGUSR1);
+  sigaddset(&mask, SIGHUP);
+  if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
+    LOG_ERROR("Failed to block signals (%s)", strerror(errno));
+  signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (signal_fd < 0)
+    LOG_ERROR("Failed to create signalfd (%s)", strerror(errno));
+}
+static void handle_connection_fd(int fd, uint32_t events, void *data) {
+  xcb_generic_event_t *event = xcb_poll_for_event(connection);
+  if (event) handle_xcb_events(event);
+  else if (xcb_connection_has_error(connection))
+    LOG_ERROR(
+        "Lost connection to X server (%d)",
+        xcb_connection_has_error(connection)
+    );
+}
+static void handle_signal_fd(int fd, uint32_t events, void *data) {
+  struct signalfd_siginfo info;
+  while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+    switch (info.ssi_signo) {
+      case SIGCHLD:
+        launcher_reap();
+        break;
+      case SIGINT:
+      case SIGTERM:
+        LOG_INFO("Got signal %d, quitting", (int)info.ssi_signo);
+        running = false;
+        break;
+      case SIGUSR1:
+        dump_stats(STDERR_FILENO);
+        break;
+      case SIGHUP:
+        config_outdated = true;
+        break;
+    }
+  }
+}
+static void handle_config_watch_fd(int fd, uint32_t events, void *data) {
+  /* Any number of changes to the file make one reload */
+  char buffer[4096]
+    __attribute__((aligned(__alignof__(struct inotify_event))));
+  const char *slash = strrchr(config_path, '/');
+  const char *name = slash ? slash + 1 : config_path;
+  ssize_t length;
+  while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+    for (char *next = buffer; next < buffer + length;) {
+      const struct inotify_event *event = (const struct inotify_event *)next;
+      if (event->len && !strcmp(event->name, name)) config_outdated = true;
+      next += sizeof(struct inotify_event) + event->len;
+    }
+  }
+}
+
+/* Event batching */
+static void handle_xcb_events(xcb_generic_event_t *first) {
+  /* Take whatever else is already queued behind the first event */
+  xcb_generic_event_t *events[EVENT_BATCH_SIZE];
+  uint32_t num_events = 0;
+  events[num_events++] = first;
+  while (num_events < EVENT_BATCH_SIZE) {
+    events[num_events] = xcb_poll_for_queued_event(connection);
+    if (!events[num_events]) break;
+    num_events++;
+  }
+  if (trace_recording()) trace_record(events, num_events);
+  handle_event_batch(events, num_events);
+}
+static void handle_event_batch(
+    xcb_generic_event_t **events, uint32_t num_events
+) {
+  coalesce_events(events, num_events);
+  for (uint32_t i = 0; i < num_events; i++) {
+    if (!events[i]) continue;
+    dispatch_event(events[i]);
+    free(events[i]);
+  }
+}
+static void dispatch_event(xcb_generic_event_t *event) {
+  uint8_t type = event->response_type & ~0x80;
+  if (xkb_event_base && type == xkb_event_base) {
+    STATS_BEGIN();
+    handle_xkb_event((xkb_event_t *)event);
+    STATS_END(type);
+    return;
+  }
+  if (randr_event_base
+      && type == randr_event_base + XCB_RANDR_SCREEN_CHANGE_NOTIFY) {
+    outputs_outdated = true;
+    return;
+  }
+  if (type < (sizeof(EVENT_HANDLERS)/sizeof(EVENT_HANDLERS[0])))
+    if (EVENT_HANDLERS[type])
+      EVENT_HANDLERS[type](event);
+}
+static void coalesce_events(xcb_generic_event_t **events, uint32_t num_events) {
+  /*
+   * Track the latest configure and map request for each window in the batch.
+   * Dropped events are freed and set to NULL so the dispatch loop skips them
+   */
+  struct {
+    xcb_window_t window;
+    int32_t configure;
+    int32_t map;
+  } pending[EVENT_BATCH_SIZE];
+  uint32_t num_pending = 0;
+  int32_t motion = -1;
+
+  for (uint32_t i = 0; i < num_events; i++) {
+    uint8_t type = events[i]->response_type & ~0x80;
+    /* Only the latest pointer position counts, up to the next button */
+    if (type == XCB_MOTION_NOTIFY) {
+      if (motion >= 0) {
+        free(events[motion]);
+        events[motion] = NULL;
+      }
+      motion = i;
+      continue;
+    }
+    if (type == XCB_BUTTON_PRESS || type == XCB_BUTTON_RELEASE) {
+      motion = -1;
+      continue;
+    }
+    xcb_window_t window;
+    if (type == XCB_CONFIGURE_REQUEST)
+      window = ((xcb_configure_request_event_t *)events[i])->window;
+    else if (type == XCB_MAP_REQUEST)
+      window = ((xcb_map_request_event_t *)events[i])->window;
+    else if (type == XCB_DESTROY_NOTIFY)
+      window = ((xcb_destroy_notify_event_t *)events[i])->window;
+    else continue;
+
+    uint32_t p = 0;
+    while (p < num_pending && pending[p].window != window) p++;
+    if (p == num_pending) {
+      pending[p].window = window;
+      pending[p].configure = -1;
+      pending[p].map = -1;
+      num_pending++;
+    }
+
+    if (type == XCB_CONFIGURE_REQUEST) {
+      /* Fold the earlier request into this one, so only the last is sent */
+      if (pending[p].configure >= 0) {
+        merge_configure_requests(
+            (xcb_configure_request_event_t *)events[pending[p].configure],
+            (xcb_configure_request_event_t *)events[i]
+        );
+        free(events[pending[p].configure]);
+        events[pending[p].configure] = NULL;
+      }
+      pending[p].configure = i;
+    } else if (type == XCB_MAP_REQUEST) {
+      /* Configures before a map have to stay before it */
+      pending[p].configure = -1;
+      pending[p].map = i;
+    } else {
+      /* Nothing queued for a destroyed window can succeed */
+      if (pending[p].configure >= 0) {
+        free(events[pending[p].configure]);
+        events[pending[p].configure] = NULL;
+      }
+      if (pending[p].map >= 0) {
+        free(events[pending[p].map]);
+        events[pending[p].map] = NULL;
+      }
+      pending[p].configure = -1;
+      pending[p].map = -1;
+    }
+  }
+}
+static void merge_configure_requests(
+    const xcb_configure_request_event_t *older,
+    xcb_configure_request_event_t *newer
+) {
+  uint16_t missing = older->value_mask & ~newer->value_mask;
+  /* A sibling only means something with the stack mode it came with */
+  if (newer->value_mask & XCB_CONFIG_WINDOW_STACK_MODE)
+    missing &= ~XCB_CONFIG_WINDOW_SIBLING;
+  if (missing & XCB_CONFIG_WINDOW_X) newer->x = older->x;
+  if (missing & XCB_CONFIG_WINDOW_Y) newer->y = older->y;
+  if (missing & XCB_CONFIG_WINDOW_WIDTH) newer->width = older->width;
+  if (missing & XCB_CONFIG_WINDOW_HEIGHT) newer->height = older->height;
+  if (missing & XCB_CONFIG_WINDOW_BORDER_WIDTH)
+    newer->border_width = older->border_width;
+  if (missing & XCB_CONFIG_WINDOW_SIBLING) newer->sibling = older->sibling;
+  if (missing & XCB_CONFIG_WINDOW_STACK_MODE)
+    newer->stack_mode = older->stack_mode;
+  newer->value_mask |= missing;
+}
+
+/* Manipulating windows */
+static client_t *manage_window(xcb_window_t window) {
+  client_t *client = client_find(window);
+  if (client) return client;
+  client = client_add(window);
+  /*
+   * The frame takes over redirecting the client's map and configure requests
+   * from the root. It's sized by the first layout, before it's mapped
+   */
+  xcb_window_t frame = xcb_generate_id(connection);
+  uint32_t frame_values[] = {
+    BORDER_UNFOCUSED,
+    XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT | XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY
+  };
+  xcb_create_window(
+      connection, XCB_COPY_FROM_PARENT, frame, root,
+      0, 0, 1, 1, BORDER_WIDTH,
+      XCB_WINDOW_CLASS_INPUT_OUTPUT, XCB_COPY_FROM_PARENT,
+      XCB_CW_BORDER_PIXEL | XCB_CW_EVENT_MASK, frame_values
+  );
+  client_set_frame(client, frame);
+  client->border = BORDER_UNFOCUSED;
+  /* Unchecked, the window may already be gone by the time these arrive */
+  uint32_t border_width = 0;
+  xcb_configure_window(
+      connection, window, XCB_CONFIG_WINDOW_BORDER_WIDTH, &border_width
+  );
+  uint32_t event_mask =
+    XCB_EVENT_MASK_FOCUS_CHANGE | XCB_EVENT_MASK_PROPERTY_CHANGE;
+  xcb_change_window_attributes(
+      connection, window, XCB_CW_EVENT_MASK, &event_mask
+  );
+  /* After selecting PropertyNotify, so no change can slip in between */
+  request_properties(client, CLIENT_PROPERTIES_ALL);
+  /* The server puts the client back on the root if pwm goes away */
+  xcb_change_save_set(connection, XCB_SET_MODE_INSERT, window);
+  xcb_reparent_window(connection, window, frame, 0, 0);
+  LOG_INFO("Managing window %d (%d clients)", (int)window, client_count());
+  return client;
+}
+static void release_client(client_t *client) {
+  /*
+   * Withdrawn, so it's given back to the root where its frame had it, before
+   * the frame goes and would take it along
+   */
+  xcb_reparent_window(
+      connection, client->window, root,
+      client->sent.x + BORDER_WIDTH, client->sent.y + BORDER_WIDTH
+  );
+  xcb_change_save_set(connection, XCB_SET_MODE_DELETE, client->window);
+  unmanage_client(client);
+}
+static void unmanage_client(client_t *client) {
+  if (client->mapped) detach_client(client);
+  if (focused == client) {
+    focused = NULL;
+    ewmh_outdated = true;
+  }
+  if (focus_target == client) focus_target = NULL;
+  if (drag.client == client) end_drag();
+  if (client->decoration_dirty) {
+    client_t **link = &dirty_decorations;
+    while (*link != client) link = &(*link)->next_dirty;
+    *link = client->next_dirty;
+  }
+  discard_properties(client);
+  LOG_INFO("Unmanaging window %d", (int)client->window);
+  xcb_destroy_window(connection, client->frame);
+  client_remove(client);
+}
+static void attach_client(client_t *client, uint32_t output) {
+  /* New clients go wherever the user is looking */
+  uint32_t workspace = outputs[output].workspace;
+  client_list_append(&outputs[output].workspaces[workspace].clients, client);
+  client->output = output;
+  client->workspace = workspace;
+  client->mapped = true;
+  mark_workspace(output, workspace);
+  /* Reachable by cycling before it's ever been focused */
+  client_focus_append(&focus_order, client);
+  list_ewmh_client(client);
+  mark_bar();
+  publish_ipc_event(IPC_EVENT_MAP, client);
+}
+static void detach_client(client_t *client) {
+  client_list_remove(
+      &outputs[client->output].workspaces[client->workspace].clients, client
+  );
+  client->mapped = false;
+  client->hidden = false;
+  mark_workspace(client->output, client->workspace);
+  client_focus_remove(&focus_order, client);
+  if (cycle_candidate == client) {
+    cycle_candidate = recent_visible_client();
+    mark_decoration(cycle_candidate);
+  }
+  /* Focus falls back to whichever client had it before */
+  if (focus_target == client || (focused == client && !focus_outdated))
+    focus_client(recent_visible_client());
+  unlist_ewmh_client(client);
+  mark_bar();
+  publish_ipc_event(IPC_EVENT_UNMAP, client);
+}
+static void arrange(void) {
+  layout_dirty = false;
+  for (uint32_t o = 0; o < num_outputs; o++) {
+    output_t *output = &outputs[o];
+    workspace_t *workspace = &output->workspaces[output->workspace];
+    if (!workspace->dirty) continue;
+    workspace->dirty = false;
+    /* Floating clients keep their place in the list, but not in the layout */
+    uint32_t tiled = 0;
+    for (client_t *client = workspace->clients.head; client;
+        client = client->next)
+      tiled += !client->floating;
+    rect_t *layout_rects = arena_alloc(&pass_arena, sizeof(rect_t)*tiled);
+    layout_apply(workspace->layout, work_area(o), tiled, layout_rects);
+
+    /* Only clients whose rectangle changed get a configure */
+    uint32_t i = 0;
+    for (client_t *client = workspace->clients.head; client;
+        client = client->next) {
+      if (!client->floating) {
+        rect_t rect = layout_rects[i++];
+        if (TILED_SIZE_HINTS) rect = apply_size_hints(client, rect);
+        if (!rect_equal(client->sent, rect)) send_client_rect(client, rect);
+      }
+      /* New clients are mapped after their first configure, to not jump */
+      if (client->needs_map) {
+        /* The frame goes up last, with the client already in it */
+        xcb_map_window(connection, client->window);
+        xcb_map_window(connection, client->frame);
+        client->needs_map = false;
+      }
+    }
+  }
+}
+static void send_client_rect(client_t *client, rect_t rect) {
+  /* Rectangles include the frame's border, which X draws outside it */
+  uint32_t value_list[4] = {
+    (uint32_t)(int32_t)rect.x, (uint32_t)(int32_t)rect.y,
+    strip_border(rect.width), strip_border(rect.height)
+  };
+  xcb_configure_window(
+      connection, client->frame,
+      XCB_CONFIG_WINDOW_X
+      | XCB_CONFIG_WINDOW_Y
+      | XCB_CONFIG_WINDOW_WIDTH
+      | XCB_CONFIG_WINDOW_HEIGHT,
+      value_list
+  );
+  bool resized = rect.width != client->sent.width
+    || rect.height != client->sent.height;
+  client->sent = rect;
+  mark_snapshot();
+  /* Moving the frame moves the client without telling it (ICCCM 4.1.5) */
+  if (resized)
+    xcb_configure_window(
+        connection, client->window,
+        XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
+        value_list + 2
+    );
+  else
+    send_configure_notify(client);
+}
+static void send_configure_notify(client_t *client) {
+  /* xcb_send_event() always sends 32 bytes */
+  union {
+    xcb_configure_notify_event_t event;
+    char bytes[32];
+  } notify = { .event = {
+    .response_type = XCB_CONFIGURE_NOTIFY,
+    .event = client->window,
+    .window = client->window,
+    .above_sibling = XCB_NONE,
+    .x = client->sent.x + BORDER_WIDTH,
+    .y = client->sent.y + BORDER_WIDTH,
+    .width = strip_border(client->sent.width),
+    .height = strip_border(client->sent.height),
+    .border_width = 0,
+    .override_redirect = 0
+  } };
+  xcb_send_event(
+      connection, 0, client->window,
+      XCB_EVENT_MASK_STRUCTURE_NOTIFY, notify.bytes
+  );
+}
+static uint16_t strip_border(uint16_t size) {
+  /* Windows can't be empty */
+  return size > 2*BORDER_WIDTH ? size - 2*BORDER_WIDTH : 1;
+}
+static void mark_workspace(uint32_t output, uint32_t workspace) {
+  outputs[output].workspaces[workspace].dirty = true;
+  mark_snapshot();
+  /* Hidden workspaces wait until they're shown */
+  if (outputs[output].workspace == workspace) layout_dirty = true;
+}
+static bool client_visible(const client_t *client) {
+  return outputs[client->output].workspace == client->workspace;
+}
+static void sync_client_visibility(client_t *client) {
+  /* Clients waiting on their first layout are mapped by arrange() anyway */
+  if (!client->mapped || client->needs_map) return;
+  if (!client_visible(client) && !client->hidden) {
+    if (drag.client == client) end_drag();
+    /* The frame goes first, so the client doesn't vanish from inside it */
+    xcb_unmap_window(connection, client->frame);
+    xcb_void_cookie_t cookie = xcb_unmap_window(connection, client->window);
+    client->unmap_sequence = cookie.sequence;
+    client->unmap_pending = true;
+    client->hidden = true;
+  } else if (client_visible(client) && client->hidden) {
+    /* Mapped again by arrange(), after any layout it missed */
+    client->hidden = false;
+    client->needs_map = true;
+    mark_workspace(client->output, client->workspace);
+  }
+}
+static void view_workspace(uint32_t output, uint32_t workspace) {
+  /* Only recorded here, so switching back and forth in a pass costs nothing */
+  if (outputs[output].workspace == workspace) return;
+  outputs[output].workspace = workspace;
+  workspaces_outdated = true;
+  mark_bar();
+  mark_snapshot();
+  if (outputs[output].workspaces[workspace].dirty) layout_dirty = true;
+}
+static void send_to_workspace(client_t *client, uint32_t workspace) {
+  move_client(client, client->output, workspace);
+}
+static void move_client(client_t *client, uint32_t output, uint32_t workspace) {
+  if (client->output == output && client->workspace == workspace) return;
+  client_list_remove(
+      &outputs[client->output].workspaces[client->workspace].clients, client
+  );
+  mark_workspace(client->output, client->workspace);
+  client_list_append(&outputs[output].workspaces[workspace].clients, client);
+  client->output = output;
+  client->workspace = workspace;
+  mark_workspace(output, workspace);
+  mark_bar();
+  sync_client_visibility(client);
+  if (!client_visible(client)
+      && (focus_target == client || (focused == client && !focus_outdated)))
+    focus_client(recent_visible_client());
+}
+static void update_workspaces(void) {
+  /*
+   * Every client that changes sides is one unmap or map, all sent in the same
+   * flush with no replies to wait on
+   */
+  workspaces_outdated = false;
+  for (uint32_t o = 0; o < num_outputs; o++) {
+    output_t *output = &outputs[o];
+    if (output->shown == output->workspace) continue;
+    uint32_t changed[] = { output->shown, output->workspace };
+    for (uint32_t i = 0; i < 2; i++)
+      for (client_t *client = output->workspaces[changed[i]].clients.head;
+          client; client = client->next)
+        sync_client_visibility(client);
+    output->shown = output->workspace;
+  }
+  /* Focus stays with what can be seen */
+  client_t *target = focus_outdated ? focus_target : focused;
+  if (!target || !client_visible(target))
+    focus_client(recent_visible_client());
+}
+static client_t *recent_visible_client(void) {
+  for (client_t *client = focus_order.head; client; client = client->focus_next)
+    if (client_visible(client)) return client;
+  return NULL;
+}
+static void focus_client(client_t *client) {
+  focus_target = client;
+  focus_outdated = true;
+}
+static void update_focus(void) {
+  focus_outdated = false;
+  /* However often focus moved since the last flush, only one request goes */
+  if (focus_target && focus_target == focused) return;
+  xcb_set_input_focus(
+      connection, XCB_INPUT_FOCUS_POINTER_ROOT,
+      focus_target ? focus_target->window : XCB_INPUT_FOCUS_POINTER_ROOT,
+      XCB_CURRENT_TIME
+  );
+}
+static void end_cycle(void) {
+  cycling = false;
+  xcb_ungrab_keyboard(connection, XCB_CURRENT_TIME);
+  mark_decoration(focused);
+  mark_decoration(cycle_candidate);
+  if (cycle_candidate) {
+    uint32_t stack_mode = XCB_STACK_MODE_ABOVE;
+    xcb_configure_window(
+        connection, cycle_candidate->frame,
+        XCB_CONFIG_WINDOW_STACK_MODE, &stack_mode
+    );
+    focus_client(cycle_candidate);
+  }
+  cycle_candidate = NULL;
+}
+static void mark_decoration(client_t *client) {
+  if (!client || client->decoration_dirty) return;
+  client->decoration_dirty = true;
+  client->next_dirty = dirty_decorations;
+  dirty_decorations = client;
+}
+static void update_decorations(void) {
+  /*
+   * Borders are drawn by the server, so a decoration change is one attribute
+   * and no redraw. However often focus moved, each frame changes at most once
+   */
+  while (dirty_decorations) {
+    client_t *client = dirty_decorations;
+    dirty_decorations = client->next_dirty;
+    client->decoration_dirty = false;
+    /* While cycling, the candidate is shown as focused instead */
+    client_t *lit = cycling ? cycle_candidate : focused;
+    uint32_t border = client == lit ? BORDER_FOCUSED : BORDER_UNFOCUSED;
+    if (border == client->border) continue;
+    xcb_change_window_attributes(
+        connection, client->frame, XCB_CW_BORDER_PIXEL, &border
+    );
+    client->border = border;
+  }
+}
+static void set_event_mask(xcb_window_t window, uint32_t event_mask) {
+  xcb_generic_error_t *error = NULL;
+  xcb_void_cookie_t cookie = xcb_change_window_attributes(
+      connection, window, XCB_CW_EVENT_MASK, &event_mask
+  );
+  STATS_ROUND_TRIP();
+  error = xcb_request_check(connection, cookie);
+  if (error) {
+    int error_code = error->error_code;
+    free(error);
+    LOG_ERROR(
+        "Failed to change event mask of window %d (%d)",
+        (int)window, error_code
+    );
+  }
+}
+static void set_window_rect(
+    xcb_window_t window, uint16_t x, uint16_t y, uint16_t width, uint16_t height
+);
+
+/* Client properties */
+static void request_properties(client_t *client, uint8_t properties) {
+  /* Ones already on their way are refetched after their reply, if need be */
+  properties &= ~client->properties_pending;
+  if (!properties) return;
+  if (!client->properties_pending) {
+    client->next_fetch = fetching_clients;
+    fetching_clients = client;
+  }
+  client->properties_pending |= properties;
+  xcb_window_t window = client->window;
+  xcb_get_property_cookie_t *cookies = client->property_cookies;
+  if (properties & 1u << CLIENT_PROPERTY_NORMAL_HINTS)
+    cookies[CLIENT_PROPERTY_NORMAL_HINTS] =
+      xcb_icccm_get_wm_normal_hints_unchecked(connection, window);
+  if (properties & 1u << CLIENT_PROPERTY_HINTS)
+    cookies[CLIENT_PROPERTY_HINTS] =
+      xcb_icccm_get_wm_hints_unchecked(connection, window);
+  if (properties & 1u << CLIENT_PROPERTY_CLASS)
+    cookies[CLIENT_PROPERTY_CLASS] =
+      xcb_icccm_get_wm_class_unchecked(connection, window);
+  if (properties & 1u << CLIENT_PROPERTY_TRANSIENT_FOR)
+    cookies[CLIENT_PROPERTY_TRANSIENT_FOR] =
+      xcb_icccm_get_wm_transient_for_unchecked(connection, window);
+  if (properties & 1u << CLIENT_PROPERTY_NET_NAME)
+    cookies[CLIENT_PROPERTY_NET_NAME] = xcb_get_property_unchecked(
+        connection, 0, window, _NET_WM_NAME, UTF8_STRING,
+        0, PROPERTY_TEXT_LENGTH
+    );
+  if (properties & 1u << CLIENT_PROPERTY_NAME)
+    cookies[CLIENT_PROPERTY_NAME] = xcb_get_property_unchecked(
+        connection, 0, window, XCB_ATOM_WM_NAME, XCB_GET_PROPERTY_TYPE_ANY,
+        0, PROPERTY_TEXT_LENGTH
+    );
+}
+static void read_properties(void) {
+  STATS_ROUND_TRIP();
+  client_t *fetched = fetching_clients;
+  fetching_clients = NULL;
+  while (fetched) {
+    client_t *client = fetched;
+    fetched = client->next_fetch;
+    uint8_t properties = client->properties_pending;
+    client->properties_pending = 0;
+    for (uint32_t p = 0; p < CLIENT_NUM_PROPERTIES; p++)
+      if (properties & 1u << p) read_property(client, p);
+    bool first = !client->properties_read;
+    client->properties_read = true;
+
+    if (client->mapped && first && client->needs_map) {
+      /*
+       * Nothing of a new window has been sent yet, so it goes straight where
+       * its rules and transience say. Transients float over their parent
+       */
+      client->floating = client->transient_for != XCB_NONE;
+      apply_rules(client);
+      if (client->floating) send_client_rect(client, place_floating(client));
+    } else if (client->mapped && TILED_SIZE_HINTS && !client->floating
+        && properties & 1u << CLIENT_PROPERTY_NORMAL_HINTS) {
+      mark_workspace(client->output, client->workspace);
+    }
+    /* Changes the server made after reading them need another fetch */
+    if (client->properties_stale) {
+      uint8_t stale = client->properties_stale;
+      client->properties_stale = 0;
+      request_properties(client, stale);
+    }
+  }
+}
+static void read_property(client_t *client, client_property_t property) {
+  /* Properties that are unset, malformed or gone leave their copy zeroed */
+  xcb_get_property_cookie_t cookie = client->property_cookies[property];
+  switch (property) {
+    case CLIENT_PROPERTY_NORMAL_HINTS:
+      if (!xcb_icccm_get_wm_normal_hints_reply(
+            connection, cookie, &client->size_hints, NULL
+          ))
+        client->size_hints = (xcb_size_hints_t){ 0 };
+      break;
+    case CLIENT_PROPERTY_HINTS:
+      if (!xcb_icccm_get_wm_hints_reply(
+            connection, cookie, &client->hints, NULL
+          ))
+        client->hints = (xcb_icccm_wm_hints_t){ 0 };
+      break;
+    case CLIENT_PROPERTY_CLASS: {
+      free(client->instance);
+      client->instance = NULL;
+      client->class_name = NULL;
+      xcb_icccm_get_wm_class_reply_t wm_class;
+      if (!xcb_icccm_get_wm_class_reply(connection, cookie, &wm_class, NULL))
+        break;
+      /* Both strings go in one block, freed with the client */
+      size_t instance_size = strlen(wm_class.instance_name) + 1;
+      size_t class_size = strlen(wm_class.class_name) + 1;
+      client->instance = malloc(instance_size + class_size);
+      if (client->instance) {
+        memcpy(client->instance, wm_class.instance_name, instance_size);
+        memcpy(
+            client->instance + instance_size, wm_class.class_name, class_size
+        );
+        client->class_name = client->instance + instance_size;
+      } else {
+        LOG_WARNING("Failed to allocate class of %d", (int)client->window);
+      }
+      xcb_icccm_get_wm_class_reply_wipe(&wm_class);
+      break;
+    }
+    case CLIENT_PROPERTY_TRANSIENT_FOR:
+      if (!xcb_icccm_get_wm_transient_for_reply(
+            connection, cookie, &client->transient_for, NULL
+          ))
+        client->transient_for = XCB_NONE;
+      break;
+    case CLIENT_PROPERTY_NET_NAME:
+      free(client->net_name);
+      client->net_name = copy_property_text(
+          xcb_get_property_reply(connection, cookie, NULL)
+      );
+      if (client == focused) mark_bar();
+      break;
+    case CLIENT_PROPERTY_NAME:
+      free(client->name);
+      client->name = copy_property_text(
+          xcb_get_property_reply(connection, cookie, NULL)
+      );
+      if (client == focused) mark_bar();
+      break;
+    default:
+      break;
+  }
+}
+static char *copy_property_text(xcb_get_property_reply_t *reply) {
+  /* Takes the reply. NULL when there's no text */
+  int length = reply && reply->format == 8
+    ? xcb_get_property_value_length(reply) : 0;
+  char *text = length ? malloc(length + 1) : NULL;
+  if (text) {
+    memcpy(text, xcb_get_property_value(reply), length);
+    text[length] = '\0';
+  }
+  free(reply);
+  return text;
+}
+static void discard_properties(client_t *client) {
+  if (!client->properties_pending) return;
+  /* XCB keeps replies until they're read, unless told not to */
+  for (uint32_t p = 0; p < CLIENT_NUM_PROPERTIES; p++)
+    if (client->properties_pending & 1u << p)
+      xcb_discard_reply(connection, client->property_cookies[p].sequence);
+  client_t **link = &fetching_clients;
+  while (*link != client) link = &(*link)->next_fetch;
+  *link = client->next_fetch;
+  client->properties_pending = 0;
+  client->properties_stale = 0;
+}
+static rect_t apply_size_hints(const client_t *client, rect_t rect) {
+  /* ICCCM 4.1.2.3, where the base and minimum sizes stand in for each other */
+  const xcb_size_hints_t *hints = &client->size_hints;
+  int32_t base_width = 0, base_height = 0;
+  int32_t min_width = 1, min_height = 1;
+  if (hints->flags & XCB_ICCCM_SIZE_HINT_BASE_SIZE) {
+    base_width = hints->base_width;
+    base_height = hints->base_height;
+  } else if (hints->flags & XCB_ICCCM_SIZE_HINT_P_MIN_SIZE) {
+    base_width = hints->min_width;
+    base_height = hints->min_height;
+  }
+  if (hints->flags & XCB_ICCCM_SIZE_HINT_P_MIN_SIZE) {
+    min_width = hints->min_width;
+    min_height = hints->min_height;
+  } else if (hints->flags & XCB_ICCCM_SIZE_HINT_BASE_SIZE) {
+    min_width = base_width;
+    min_height = base_height;
+  }
+  int32_t width = strip_border(rect.width);
+  int32_t height = strip_border(rect.height);
+  /* Sizes are the base plus whole increments, like a terminal's cells */
+  if (hints->flags & XCB_ICCCM_SIZE_HINT_P_RESIZE_INC) {
+    if (hints->width_inc > 0 && width > base_width)
+      width -= (width - base_width) % hints->width_inc;
+    if (hints->height_inc > 0 && height > base_height)
+      height -= (height - base_height) % hints->height_inc;
+  }
+  if (width < min_width) width = min_width;
+  if (height < min_height) height = min_height;
+  if (hints->flags & XCB_ICCCM_SIZE_HINT_P_MAX_SIZE) {
+    if (hints->max_width > 0 && width > hints->max_width)
+      width = hints->max_width;
+    if (hints->max_height > 0 && height > hints->max_height)
+      height = hints->max_height;
+  }
+  /* Whatever the hints say, windows can't be empty or past 16 bits */
+  int32_t max = UINT16_MAX - 2*BORDER_WIDTH;
+  rect.width = (width < 1 ? 1 : width > max ? max : width) + 2*BORDER_WIDTH;
+  rect.height = (height < 1 ? 1 : height > max ? max : height) + 2*BORDER_WIDTH;
+  return rect;
+}
+static client_property_t find_client_property(xcb_atom_t atom) {
+  /* Interned at startup, so not a case */
+  if (atom == _NET_WM_NAME) return CLIENT_PROPERTY_NET_NAME;
+  switch (atom) {
+    case XCB_ATOM_WM_NORMAL_HINTS: return CLIENT_PROPERTY_NORMAL_HINTS;
+    case XCB_ATOM_WM_HINTS: return CLIENT_PROPERTY_HINTS;
+    case XCB_ATOM_WM_CLASS: return CLIENT_PROPERTY_CLASS;
+    case XCB_ATOM_WM_TRANSIENT_FOR: return CLIENT_PROPERTY_TRANSIENT_FOR;
+    case XCB_ATOM_WM_NAME: return CLIENT_PROPERTY_NAME;
+    default: return CLIENT_NUM_PROPERTIES;
+  }
+}
+static rect_t place_floating(const client_t *client) {
+  /* Centred over its parent, or its output if it has none laid out */
+  const client_t *parent = client_find(client->transient_for);
+  rect_t over = parent && parent->mapped && parent->sent.width
+    ? parent->sent : work_area(client->output);
+  /* At the size it asked for, or half its parent's */
+  const xcb_size_hints_t *hints = &client->size_hints;
+  rect_t rect = { 0, 0, over.width/2, over.height/2 };
+  if (hints->flags & (XCB_ICCCM_SIZE_HINT_US_SIZE | XCB_ICCCM_SIZE_HINT_P_SIZE)
+      && hints->width > 0 && hints->height > 0) {
+    rect.width = hints->width < UINT16_MAX/2 ? hints->width : UINT16_MAX/2;
+    rect.height = hints->height < UINT16_MAX/2 ? hints->height : UINT16_MAX/2;
+    rect.width += 2*BORDER_WIDTH;
+    rect.height += 2*BORDER_WIDTH;
+  }
+  rect = apply_size_hints(client, rect);
+  rect.x = over.x + ((int32_t)over.width - rect.width)/2;
+  rect.y = over.y + ((int32_t)over.height - rect.height)/2;
+  return rect;
+}
+
+/* Rules */
+static rules_t *compile_rules(const config_t *config) {
+  /* A config file replaces the compiled in rules, like it does keymaps */
+  rules_t *compiled = config
+    ? rules_compile(config->rules, config->num_rules)
+    : rules_compile(_RULES, NUM_RULES);
+  if (!compiled) LOG_ERROR("Failed to compile rules");
+  return compiled;
+}
+static void apply_rules(client_t *client) {
+  const char *strings[RULE_FIELDS] = {
+    [RULE_CLASS] = client->class_name,
+    [RULE_INSTANCE] = client->instance,
+    [RULE_TITLE] = client_title(client)
+  };
+  rule_t rule;
+  if (!rules || !rules_match(rules, strings, &rule)) return;
+  /* Outputs and workspaces that don't exist are left be */
+  uint32_t output = client->output;
+  if (rule.output > 0 && (uint32_t)rule.output <= num_outputs)
+    output = rule.output - 1;
+  uint32_t workspace =
+    output == client->output ? client->workspace : outputs[output].workspace;
+  if (rule.workspace > 0 && rule.workspace <= WORKSPACES)
+    workspace = rule.workspace - 1;
+  move_client(client, output, workspace);
+  if (rule.floating >= 0) client->floating = rule.floating;
+  LOG_INFO(
+      "Rules put window %d on output %u, workspace %u%s", (int)client->window,
+      output + 1, workspace + 1, client->floating ? ", floating" : ""
+  );
+}
+
+/* Pointer drags */
+static void setup_drag(void) {
+  /* Grabbed on the root, so they win over whatever window is underneath */
+  static const xcb_button_t buttons[] = { MOVE_BUTTON, RESIZE_BUTTON };
+  for (uint32_t i = 0; i < sizeof(buttons)/sizeof(buttons[0]); i++)
+    xcb_grab_button(
+        connection, 0, root,
+        XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE
+        | XCB_EVENT_MASK_BUTTON_MOTION,
+        XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC, XCB_NONE, XCB_NONE,
+        buttons[i], DRAG_MODIFIERS
+    );
+  drag_timer = loop_timer_add(handle_drag_timer, NULL);
+}
+static void begin_drag(
+    client_t *client, drag_mode_t mode, const xcb_button_press_event_t *event
+) {
+  /* Dragged clients float, like moved ones */
+  if (!client->floating) mark_workspace(client->output, client->workspace);
+  client->floating = true;
+  drag = (drag_t){
+    .mode = mode,
+    .client = client,
+    .button = event->detail,
+    .start_x = event->root_x,
+    .start_y = event->root_y,
+    .start = client->sent,
+    .x = event->root_x,
+    .y = event->root_y
+  };
+  uint32_t stack_mode = XCB_STACK_MODE_ABOVE;
+  xcb_configure_window(
+      connection, client->frame, XCB_CONFIG_WINDOW_STACK_MODE, &stack_mode
+  );
+  focus_client(client);
+}
+static void update_drag(void) {
+  drag.pending = false;
+  rect_t rect = drag.start;
+  int32_t dx = drag.x - drag.start_x;
+  int32_t dy = drag.y - drag.start_y;
+  if (drag.mode == DRAG_MOVE) {
+    rect.x += dx;
+    rect.y += dy;
+  } else {
+    /* Windows can't be empty, and X sizes are 16 bits */
+    int32_t width = rect.width + dx;
+    int32_t height = rect.height + dy;
+    int32_t min = 2*BORDER_WIDTH + 1;
+    rect.width = width < min ? min : width > UINT16_MAX ? UINT16_MAX : width;
+    rect.height =
+      height < min ? min : height > UINT16_MAX ? UINT16_MAX : height;
+    rect = apply_size_hints(drag.client, rect);
+  }
+  if (rect_equal(rect, drag.client->sent)) return;
+  send_client_rect(drag.client, rect);
+  /* Nothing more until the output's next frame */
+  if (drag_timer < 0) return;
+  loop_timer_arm(drag_timer, outputs[drag.client->output].frame_ns, 0);
+  drag.paced = true;
+}
+static void end_drag(void) {
+  if (drag_timer >= 0) loop_timer_disarm(drag_timer);
+  drag = (drag_t){ .mode = DRAG_NONE };
+}
+static void handle_drag_timer(int fd, uint32_t events, void *data) {
+  /* The pass this runs in sends whatever the pointer did since */
+  drag.paced = false;
+}
+
+/* Rendering */
+static void setup_render(void) {
+  /* Nothing gets drawn without it, but windows are still managed */
+  render_fd = render_init();
+  if (render_fd < 0) {
+    LOG_WARNING("Failed to start the render worker (%s)", strerror(errno));
+    return;
+  }
+  loop_watch(render_fd, EPOLLIN, handle_render_fd, NULL);
+  /* In 4 byte units, less PutImage's own header */
+  uint64_t max = (uint64_t)xcb_get_maximum_request_length(connection)*4;
+  if (max > UINT32_MAX) max = UINT32_MAX;
+  put_image_max = max - sizeof(xcb_put_image_request_t);
+}
+static void handle_render_fd(int fd, uint32_t events, void *data) {
+  /* Every image that's ready, sent with this pass's flush */
+  render_image_t image;
+  while (render_collect(&image)) {
+    if (image.pixels)
+      show_bar_image(&image);
+    else
+      LOG_WARNING(
+          "Failed to allocate a %ux%u image", image.width, image.height
+      );
+    render_release(&image);
+  }
+}
+static void put_render_image(const render_image_t *image) {
+  /* Split into bands of whole rows when it's more than one request holds */
+  uint32_t row_size = image->width*sizeof(uint32_t);
+  if (!row_size || !image->height) return;
+  uint32_t band = put_image_max/row_size;
+  if (!band) return;
+  for (uint32_t row = 0; row < image->height; row += band) {
+    uint32_t rows = image->height - row < band ? image->height - row : band;
+    xcb_put_image(
+        connection, XCB_IMAGE_FORMAT_Z_PIXMAP, image->drawable, image->gc,
+        image->width, rows, image->x, image->y + row, 0, screen->root_depth,
+        rows*row_size, (const uint8_t *)(image->pixels + row*image->width)
+    );
+  }
+}
+
+/* Bar */
+static void setup_bar(void) {
+  /* Without the worker there's nothing to draw it with */
+  if (!BAR || render_fd < 0) return;
+  bar_gc = xcb_generate_id(connection);
+  uint32_t values[] = { BAR_BACKGROUND, 0 };
+  xcb_create_gc(
+      connection, bar_gc, root,
+      XCB_GC_FOREGROUND | XCB_GC_GRAPHICS_EXPOSURES, values
+  );
+  bar_timer = loop_timer_add(handle_bar_timer, NULL);
+  tick_bar_clock();
+}
+static void update_output_bars(void) {
+  if (!bar_gc) return;
+  for (uint32_t o = 0; o < num_outputs; o++) {
+    output_t *output = &outputs[o];
+    if (!output->bar_window) {
+      create_bar(o);
+      continue;
+    }
+    uint32_t place[] = {
+      (uint32_t)(int32_t)output->area.x, (uint32_t)(int32_t)output->area.y,
+      output->area.width
+    };
+    /* Only moved, and the pixmap still has everything it showed */
+    if (output->bar.width == output->area.width) {
+      xcb_configure_window(
+          connection, output->bar_window,
+          XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, place
+      );
+      continue;
+    }
+    /*
+     * Resized, so every segment is drawn again into a pixmap of the new
+     * width. Images still coming for the old one are dropped as stale
+     */
+    xcb_configure_window(
+        connection, output->bar_window,
+        XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH,
+        place
+    );
+    xcb_free_pixmap(connection, output->bar_pixmap);
+    create_bar_pixmap(o);
+    bar_resize(&output->bar, output->area.width);
+    for (uint32_t w = 0; w < WORKSPACES; w++) mark_workspace(o, w);
+    mark_bar();
+  }
+}
+static void create_bar_pixmap(uint32_t o) {
+  output_t *output = &outputs[o];
+  uint16_t width = output->area.width;
+  output->bar_pixmap = xcb_generate_id(connection);
+  xcb_create_pixmap(
+      connection, screen->root_depth, output->bar_pixmap, root,
+      width, BAR_HEIGHT
+  );
+  /* Exposed before its first segments come back, it's at least blank */
+  xcb_rectangle_t all = { 0, 0, width, BAR_HEIGHT };
+  xcb_poly_fill_rectangle(connection, output->bar_pixmap, bar_gc, 1, &all);
+}
+static void create_bar(uint32_t o) {
+  output_t *output = &outputs[o];
+  rect_t area = output->area;
+  output->bar_window = xcb_generate_id(connection);
+  uint32_t values[] = { BAR_BACKGROUND, 1, XCB_EVENT_MASK_EXPOSURE };
+  xcb_create_window(
+      connection, XCB_COPY_FROM_PARENT, output->bar_window, root,
+      area.x, area.y, area.width, BAR_HEIGHT, 0,
+      XCB_WINDOW_CLASS_INPUT_OUTPUT, XCB_COPY_FROM_PARENT,
+      XCB_CW_BACK_PIXEL | XCB_CW_OVERRIDE_REDIRECT | XCB_CW_EVENT_MASK, values
+  );
+  create_bar_pixmap(o);
+  xcb_map_window(connection, output->bar_window);
+
+  bar_init(&output->bar, area.width, BAR_HEIGHT, BAR_SCALE, BAR_PADDING);
+  for (uint32_t w = 0; w < WORKSPACES; w++) bar_add(&output->bar, BAR_LEFT);
+  bar_add(&output->bar, BAR_FILL);
+  for (uint32_t b = 0; b < BAR_BLOCKS; b++) bar_add(&output->bar, BAR_RIGHT);
+  bar_add(&output->bar, BAR_RIGHT);
+  /* Clients make room for it */
+  for (uint32_t w = 0; w < WORKSPACES; w++) mark_workspace(o, w);
+  mark_bar();
+}
+static void destroy_bar(uint32_t o) {
+  output_t *output = &outputs[o];
+  if (!output->bar_window) return;
+  xcb_destroy_window(connection, output->bar_window);
+  xcb_free_pixmap(connection, output->bar_pixmap);
+  output->bar_window = 0;
+  output->bar_pixmap = 0;
+}
+static void mark_bar(void) {
+  bar_outdated = true;
+}
+static void update_bar(void) {
+  bar_outdated = false;
+  for (uint32_t o = 0; o < num_outputs; o++)
+    if (outputs[o].bar_window) draw_bar(o);
+}
+static void draw_bar(uint32_t o) {
+  /* Everything is set again, and the fingerprints tell what changed */
+  output_t *output = &outputs[o];
+  bar_t *bar = &output->bar;
+  for (uint32_t w = 0; w < WORKSPACES; w++) {
+    char label[12];
+    snprintf(label, sizeof(label), "%u", w + 1);
+    bool shown = w == output->workspace;
+    uint32_t foreground = shown ? BAR_BACKGROUND
+      : output->workspaces[w].clients.head ? BAR_FOREGROUND : BAR_EMPTY;
+    bar_set(
+        bar, w, label, foreground, shown ? BAR_SELECTED : BAR_BACKGROUND
+    );
+  }
+  const char *title = focused && focused->mapped && focused->output == o
+    ? client_title(focused) : NULL;
+  bar_set(bar, BAR_SEGMENT_TITLE, title, BAR_FOREGROUND, BAR_BACKGROUND);
+  for (uint32_t b = 0; b < BAR_BLOCKS; b++)
+    bar_set(
+        bar, BAR_SEGMENT_BLOCKS + b, bar_blocks[b].text,
+        BAR_FOREGROUND, BAR_BACKGROUND
+    );
+  bar_set(bar, BAR_SEGMENT_CLOCK, bar_clock, BAR_FOREGROUND, BAR_BACKGROUND);
+  if (!bar_layout(bar)) return;
+
+  for (uint32_t s = 0; s < bar->num_segments; s++) {
+    bar_segment_t *segment = &bar->segments[s];
+    if (!segment->dirty) continue;
+    if (segment->width) {
+      render_job_t job;
+      bar_job(bar, s, &job);
+      job.drawable = output->bar_pixmap;
+      job.gc = bar_gc;
+      job.tag = (uint64_t)s << 32 | segment->generation;
+      /* A full queue has images coming, which wake the loop to try again */
+      if (!render_submit(&job)) {
+        mark_bar();
+        return;
+      }
+    }
+    segment->dirty = false;
+  }
+}
+static void show_bar_image(const render_image_t *image) {
+  uint32_t s = image->tag >> 32;
+  for (uint32_t o = 0; o < num_outputs; o++) {
+    output_t *output = &outputs[o];
+    if (!output->bar_window || output->bar_pixmap != image->drawable) continue;
+    /* The segment changed again since, and a newer image is on its way */
+    if (s >= output->bar.num_segments
+        || output->bar.segments[s].generation != (uint32_t)image->tag)
+      return;
+    put_render_image(image);
+    xcb_copy_area(
+        connection, output->bar_pixmap, output->bar_window, bar_gc,
+        image->x, image->y, image->x, image->y, image->width, image->height
+    );
+    return;
+  }
+}
+static void set_bar_block(const char *name, char *const words[]) {
+  /* Set as often as it likes, a block is drawn once a pass with the last */
+  if (!name || !name[0]) return;
+  char key[BAR_BLOCK_NAME_SIZE];
+  snprintf(key, sizeof(key), "%s", name);
+  bar_block_t *block = NULL;
+  bar_block_t *unused = NULL;
+  for (uint32_t b = 0; b < BAR_BLOCKS; b++) {
+    if (!strcmp(bar_blocks[b].name, key)) block = &bar_blocks[b];
+    else if (!bar_blocks[b].name[0] && !unused) unused = &bar_blocks[b];
+  }
+  if (!words[0]) {
+    if (block) *block = (bar_block_t){ 0 };
+    mark_bar();
+    return;
+  }
+  if (!block) block = unused;
+  if (!block) {
+    LOG_WARNING("No bar block left for %s", key);
+    return;
+  }
+  memcpy(block->name, key, sizeof(key));
+  size_t length = 0;
+  block->text[0] = '\0';
+  for (char *const *word = words; *word; word++) {
+    int written = snprintf(
+        block->text + length, sizeof(block->text) - length, "%s%s",
+        word == words ? "" : " ", *word
+    );
+    if (written < 0 || (size_t)written >= sizeof(block->text) - length) break;
+    length += written;
+  }
+  mark_bar();
+}
+static void tick_bar_clock(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  struct tm local;
+  char text[sizeof(bar_clock)];
+  if (!localtime_r(&now.tv_sec, &local)
+      || !strftime(text, sizeof(text), BAR_CLOCK_FORMAT, &local))
+    text[0] = '\0';
+  if (strcmp(text, bar_clock)) {
+    memcpy(bar_clock, text, sizeof(text));
+    mark_bar();
+  }
+  /* On the next multiple of the interval, so the ticks never drift */
+  uint64_t interval = BAR_CLOCK_INTERVAL*1000000000ull;
+  uint64_t into = (uint64_t)now.tv_sec % BAR_CLOCK_INTERVAL*1000000000ull
+    + now.tv_nsec;
+  if (bar_timer >= 0) loop_timer_arm(bar_timer, interval - into, 0);
+}
+static void handle_bar_timer(int fd, uint32_t events, void *data) {
+  tick_bar_clock();
+}
+static rect_t work_area(uint32_t output) {
+  /* What's left for clients once the bar has its strip */
+  rect_t area = outputs[output].area;
+  if (outputs[output].bar_window && area.height > BAR_HEIGHT) {
+    area.y += BAR_HEIGHT;
+    area.height -= BAR_HEIGHT;
+  }
+  return area;
+}
+
+/* Snapshot */
+static bool restore_snapshot(void) {
+  if (!SNAPSHOT) return false;
+  char path[PATH_MAX];
+  snapshot_path(path, sizeof(path));
+  snapshot_t snapshot;
+  if (!snapshot_load(path, root, &snapshot)) return false;
+  const snapshot_header_t *header = snapshot.header;
+
+  /* One round trip says which windows are still there, and on what server */
+  xcb_query_tree_cookie_t tree_cookie = xcb_query_tree(connection, root);
+  xcb_get_property_cookie_t token_cookie = xcb_get_property(
+      connection, 0, root, _PWM_SNAPSHOT, XCB_ATOM_CARDINAL, 0, 2
+  );
+  STATS_ROUND_TRIP();
+  xcb_query_tree_reply_t *tree =
+    xcb_query_tree_reply(connection, tree_cookie, NULL);
+  xcb_get_property_reply_t *token =
+    xcb_get_property_reply(connection, token_cookie, NULL);
+  bool same = token && token->format == 32
+    && xcb_get_property_value_length(token) == sizeof(header->token)
+    && !memcmp(
+        xcb_get_property_value(token), &header->token, sizeof(header->token)
+    );
+  free(token);
+  if (!tree || !same) {
+    LOG_INFO("Snapshot %s is from another server, adopting windows", path);
+    free(tree);
+    snapshot_unload(&snapshot);
+    return false;
+  }
+  int num_children = xcb_query_tree_children_length(tree);
+  xcb_window_t *children =
+    arena_alloc(&pass_arena, sizeof(xcb_window_t)*(num_children + 1));
+  memcpy(
+      children, xcb_query_tree_children(tree),
+      sizeof(xcb_window_t)*num_children
+  );
+  free(tree);
+  qsort(children, num_children, sizeof(xcb_window_t), compare_windows);
+
+  /* Outputs that are still there get their workspaces back */
+  uint32_t output_map[SNAPSHOT_OUTPUTS] = { 0 };
+  for (uint32_t s = 0; s < header->num_outputs; s++)
+    output_map[s] = restore_output(&snapshot, s);
+  if (header->current_output < header->num_outputs)
+    current_output = output_map[header->current_output];
+
+  /*
+   * Clients that are still there, in layout order. Kept frames are on the
+   * root with the clients still in them, otherwise it's the clients
+   */
+  const snapshot_client_t **records =
+    arena_alloc(&pass_arena, sizeof(*records)*(header->capacity + 1));
+  xcb_window_t *kept =
+    arena_alloc(&pass_arena, sizeof(xcb_window_t)*(header->capacity + 1));
+  uint32_t num_records = 0;
+  uint32_t num_kept = 0;
+  for (uint32_t id = 0; id < header->capacity; id++) {
+    const snapshot_client_t *record = &snapshot.clients[id];
+    xcb_window_t window = record->frame_kept ? record->frame : record->window;
+    if (!record->window || !bsearch(
+          &window, children, num_children, sizeof(xcb_window_t),
+          compare_windows
+        ))
+      continue;
+    records[num_records++] = record;
+    if (record->frame_kept) kept[num_kept++] = record->frame;
+  }
+  qsort(records, num_records, sizeof(*records), compare_snapshot_clients);
+  qsort(kept, num_kept, sizeof(xcb_window_t), compare_windows);
+  /*
+   * Reparented into frames of this connection's own, taken straight out of
+   * the kept ones, so the save set covers them again
+   */
+  client_t **restored =
+    arena_alloc(&pass_arena, sizeof(client_t *)*(num_records + 1));
+  for (uint32_t i = 0; i < num_records; i++) {
+    /* A window is only put in one place, even if it was left in two */
+    xcb_window_t window = records[i]->window;
+    restored[i] = client_find(window) ? NULL : manage_window(window);
+  }
+  /* Before any are attached, so no rule sends them anywhere else */
+  if (fetching_clients) read_properties();
+
+  for (uint32_t i = 0; i < num_records; i++) {
+    const snapshot_client_t *record = records[i];
+    client_t *client = restored[i];
+    if (!client) continue;
+    if (record->iconic) {
+      /* The save set maps what it puts back on the root, so it's undone */
+      if (!record->frame_kept) xcb_unmap_window(connection, client->window);
+      continue;
+    }
+    uint32_t output =
+      record->output < header->num_outputs ? output_map[record->output] : 0;
+    uint32_t workspace = record->workspace < WORKSPACES ? record->workspace : 0;
+    client_list_append(&outputs[output].workspaces[workspace].clients, client);
+    client->output = output;
+    client->workspace = workspace;
+    client->mapped = true;
+    client->floating = record->floating;
+    /*
+     * A client stays mapped in a kept frame unless pwm hid it, and the save
+     * set maps every one it puts back on the root
+     */
+    client->hidden = record->frame_kept && record->hidden;
+    client->border = record->focus ? BORDER_UNFOCUSED : BORDER_FOCUSED;
+    mark_decoration(client);
+    mark_workspace(output, workspace);
+    list_ewmh_client(client);
+    send_client_rect(client, record->rect);
+    sync_client_visibility(client);
+    client->needs_map = client_visible(client);
+  }
+  /* Most recently focused first, as they were */
+  qsort(records, num_records, sizeof(*records), compare_snapshot_focus);
+  for (uint32_t i = 0; i < num_records; i++)
+    if (!records[i]->iconic)
+      client_focus_append(&focus_order, client_find(records[i]->window));
+  focus_client(recent_visible_client());
+  mark_bar();
+  snapshot_unload(&snapshot);
+
+  /*
+   * The kept frames, emptied by now, and whatever else the last pwm's
+   * connection was keeping go in one request per connection they're from
+   */
+  uint32_t base_mask = ~setup->resource_id_mask;
+  for (uint32_t k = 0; k < num_kept; k++) {
+    bool killed = false;
+    for (uint32_t j = 0; j < k && !killed; j++)
+      killed = (kept[j] & base_mask) == (kept[k] & base_mask);
+    if (!killed) xcb_kill_client(connection, kept[k]);
+  }
+
+  /* Only what turned up while nobody was managing windows is asked about */
+  uint32_t num_unknown = 0;
+  for (int i = 0; i < num_children; i++) {
+    xcb_window_t window = children[i];
+    bool own = window == ewmh_check_window || bsearch(
+        &window, kept, num_kept, sizeof(xcb_window_t), compare_windows
+    );
+    for (uint32_t o = 0; o < num_outputs; o++)
+      own |= window == outputs[o].bar_window;
+    if (!own && !client_find(window)) children[num_unknown++] = window;
+  }
+  if (num_unknown) adopt_children(children, num_unknown);
+  LOG_INFO(
+      "Restored %u windows from %s, %u from frames kept by a restart",
+      num_records, path, num_kept
+  );
+  return true;
+}
+static uint32_t restore_output(const snapshot_t *snapshot, uint32_t index) {
+  /* The same CRTC, or else the same area, or else the first output */
+  const snapshot_output_t *was = &snapshot->outputs[index];
+  uint32_t o = 0;
+  while (o < num_outputs && (!was->crtc || outputs[o].crtc != was->crtc)) o++;
+  if (o == num_outputs) {
+    o = 0;
+    while (o < num_outputs && !rect_equal(outputs[o].area, was->area)) o++;
+    if (o == num_outputs) return 0;
   }
-  return _connection;
+  /* Nothing's mapped yet, so it's shown as soon as it's chosen */
+  output_t *output = &outputs[o];
+  if (was->workspace < WORKSPACES)
+    output->workspace = output->shown = was->workspace;
+  for (uint32_t w = 0; w < WORKSPACES; w++)
+    if (was->layouts[w] < NUM_LAYOUTS)
+      output->workspaces[w].layout = was->layouts[w];
+  return o;
 }
-
-static void disconnect(void) {
-  xcb_disconnect(connection);
+static int compare_snapshot_clients(const void *a, const void *b) {
+  const snapshot_client_t *first = *(const snapshot_client_t *const *)a;
+  const snapshot_client_t *second = *(const snapshot_client_t *const *)b;
+  if (first->output != second->output)
+    return first->output < second->output ? -1 : 1;
+  if (first->workspace != second->workspace)
+    return first->workspace < second->workspace ? -1 : 1;
+  return (first->order > second->order) - (first->order < second->order);
 }
-static const xcb_setup_t *get_setup(void) {
-  const xcb_setup_t *_setup =  xcb_get_setup(connection);
-  if (!_setup)
-    log_msg(LOG_LEVEL_ERROR, "Failed to get setup information");
-  return _setup;
+static int compare_snapshot_focus(const void *a, const void *b) {
+  const snapshot_client_t *first = *(const snapshot_client_t *const *)a;
+  const snapshot_client_t *second = *(const snapshot_client_t *const *)b;
+  return (first->focus > second->focus) - (first->focus < second->focus);
 }
-static xcb_screen_t *get_screen(void) {
-  /* This gets the first screen blindly (not good for several monitors) */
-  xcb_screen_iterator_t screen_iterator = xcb_setup_roots_iterator(setup);
-  xcb_screen_t *_screen = screen_iterator.data;
-  if (!_screen)
-    log_msg(LOG_LEVEL_ERROR, "Failed to get first screen");
-  return _screen;
+static int compare_windows(const void *a, const void *b) {
+  xcb_window_t first = *(const xcb_window_t *)a;
+  xcb_window_t second = *(const xcb_window_t *)b;
+  return (first > second) - (first < second);
 }
-static xcb_window_t get_root(void) {
-  return screen->root;
+static void setup_snapshot(void) {
+  if (!SNAPSHOT) return;
+  /* This run's token, left on the root for the next one to check */
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  uint64_t token = ((uint64_t)now.tv_sec*1000000000 + now.tv_nsec)
+    ^ (uint64_t)getpid() << 40;
+  char path[PATH_MAX];
+  snapshot_path(path, sizeof(path));
+  if (!snapshot_open(path, root, token)) return;
+  uint32_t halves[2];
+  memcpy(halves, &token, sizeof(token));
+  xcb_change_property(
+      connection, XCB_PROP_MODE_REPLACE, root, _PWM_SNAPSHOT,
+      XCB_ATOM_CARDINAL, 32, 2, halves
+  );
+  snapshot_timer = loop_timer_add(handle_snapshot_timer, NULL);
+  /* Complete from the start, in case of a crash before the first change */
+  update_snapshot();
+}
+static void mark_snapshot(void) {
+  if (snapshot_pending || snapshot_timer < 0) return;
+  snapshot_pending = true;
+  loop_timer_arm(snapshot_timer, SNAPSHOT_INTERVAL*1000000ull, 0);
 }
-static xcb_atom_t get_atom(const char *name) {
+static void update_snapshot(void) {
   /*
-   * It would be better to query for all atoms before reading replies, making
-   * the most of XCB's asynchronous API. It would also be more difficult, and it
-   * only has to be done once, so performance isn't that much of an issue
+   * Records are built aside and only copied in when they differ, so pages
+   * nothing changed on are never dirtied or written back
    */
-  xcb_generic_error_t *error = NULL;
-  xcb_intern_atom_cookie_t cookie = xcb_intern_atom(
-      connection, 0, strlen(name), name
-  );
-  xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(
-      connection, cookie, &error
-  );
-  if (!reply) {
-    if (error)
-      log_msg(
-          LOG_LEVEL_ERROR,
-          "Failed to get atom: %s (%d)", name, error->error_code
-      );
-    else
-      log_msg(LOG_LEVEL_ERROR, "Failed to get atom: %s", name);
+  snapshot_pending = false;
+  if (!snapshot_writing()) return;
+  snapshot_header_t *header = snapshot_begin();
+  header->num_outputs = num_outputs;
+  header->current_output = current_output;
+  for (uint32_t o = 0; o < num_outputs; o++) {
+    snapshot_output_t record;
+    memset(&record, 0, sizeof(record));
+    record.crtc = outputs[o].crtc;
+    record.area = outputs[o].area;
+    record.workspace = outputs[o].workspace;
+    for (uint32_t w = 0; w < WORKSPACES; w++)
+      record.layouts[w] = outputs[o].workspaces[w].layout;
+    snapshot_output_t *slot = snapshot_output(o);
+    if (memcmp(slot, &record, sizeof(record))) *slot = record;
   }
-  xcb_atom_t atom = reply->atom;
-  free(reply);
-  if (!atom)
-    log_msg(LOG_LEVEL_ERROR, "Failed to get atom: %s", name);
-  else
-    log_msg(LOG_LEVEL_INFO, "Got atom: %s", name);
-  return atom;
+
+  /* Ranks in the focus order, by client id */
+  uint32_t capacity = pool_capacity(client_pool());
+  uint32_t *ranks = arena_alloc(&pass_arena, sizeof(uint32_t)*(capacity + 1));
+  for (uint32_t id = 0; id < capacity; id++) ranks[id] = SNAPSHOT_NO_FOCUS;
+  uint32_t rank = 0;
+  for (client_t *client = focus_order.head; client;
+      client = client->focus_next)
+    if (client->id < capacity) ranks[client->id] = rank++;
+  /* Clients that went since */
+  for (uint32_t id = 0; id < header->capacity; id++) {
+    snapshot_client_t *record = snapshot_client(id);
+    if (record->window && !client_get(id)) memset(record, 0, sizeof(*record));
+  }
+  /* Iconic ones, so a restart doesn't lose them in the frames it kills */
+  for (uint32_t id = 0; id < capacity; id++) {
+    const client_t *client = client_get(id);
+    if (!client || client->mapped) continue;
+    snapshot_client_t record;
+    memset(&record, 0, sizeof(record));
+    record.window = client->window;
+    record.frame = client->frame;
+    record.focus = SNAPSHOT_NO_FOCUS;
+    record.rect = client->sent;
+    record.frame_kept = restarting;
+    record.iconic = true;
+    snapshot_client_t *slot = snapshot_client(id);
+    if (slot && memcmp(slot, &record, sizeof(record))) *slot = record;
+  }
+  for (uint32_t o = 0; o < num_outputs; o++) {
+    for (uint32_t w = 0; w < WORKSPACES; w++) {
+      uint32_t order = 0;
+      for (const client_t *client = outputs[o].workspaces[w].clients.head;
+          client; client = client->next) {
+        snapshot_client_t record;
+        memset(&record, 0, sizeof(record));
+        record.window = client->window;
+        record.frame = client->frame;
+        record.output = o;
+        record.workspace = w;
+        record.order = order++;
+        record.focus =
+          client->id < capacity ? ranks[client->id] : SNAPSHOT_NO_FOCUS;
+        record.rect = client->sent;
+        record.floating = client->floating;
+        record.hidden = client->hidden;
+        record.frame_kept = restarting;
+        /* Growing the file moves every record, so none are kept across */
+        snapshot_client_t *slot = snapshot_client(client->id);
+        if (slot && memcmp(slot, &record, sizeof(record))) *slot = record;
+      }
+    }
+  }
+  snapshot_end();
 }
-static void log_setup_info(void) {
-  log_msg(
-      LOG_LEVEL_INFO, "setup.protocol_major_version = %d",
-      setup->protocol_major_version
+static void handle_snapshot_timer(int fd, uint32_t events, void *data) {
+  update_snapshot();
+}
+static void keep_frames(void) {
+  /*
+   * The whole connection is kept for its frames, until the next pwm has the
+   * clients out of them and kills it. The rest is freed here already
+   */
+  for (uint32_t o = 0; o < num_outputs; o++) destroy_bar(o);
+  if (bar_gc) xcb_free_gc(connection, bar_gc);
+  if (ewmh_check_window) xcb_destroy_window(connection, ewmh_check_window);
+  bar_gc = 0;
+  ewmh_check_window = XCB_NONE;
+  xcb_set_close_down_mode(connection, XCB_CLOSE_DOWN_RETAIN_PERMANENT);
+}
+
+/* EWMH */
+static void setup_ewmh(void) {
+  /* A child window carrying pwm's name shows a compliant WM is running */
+  ewmh_check_window = xcb_generate_id(connection);
+  uint32_t override_redirect = 1;
+  xcb_create_window(
+      connection, XCB_COPY_FROM_PARENT, ewmh_check_window, root,
+      -1, -1, 1, 1, 0, XCB_WINDOW_CLASS_INPUT_ONLY, XCB_COPY_FROM_PARENT,
+      XCB_CW_OVERRIDE_REDIRECT, &override_redirect
   );
-  log_msg(
-      LOG_LEVEL_INFO, "setup.protocol_minor_version = %d",
-      setup->protocol_minor_version
+  xcb_change_property(
+      connection, XCB_PROP_MODE_REPLACE, ewmh_check_window,
+      _NET_SUPPORTING_WM_CHECK, XCB_ATOM_WINDOW, 32, 1, &ewmh_check_window
   );
-  log_msg(
-      LOG_LEVEL_INFO, "screen.width_in_millimeters = %d",
-      screen->width_in_millimeters
+  xcb_change_property(
+      connection, XCB_PROP_MODE_REPLACE, ewmh_check_window,
+      _NET_WM_NAME, UTF8_STRING, 8, 3, "pwm"
   );
-  log_msg(
-      LOG_LEVEL_INFO, "screen.height_in_millimeters = %d",
-      screen->height_in_millimeters
+  xcb_change_property(
+      connection, XCB_PROP_MODE_REPLACE, root,
+      _NET_SUPPORTING_WM_CHECK, XCB_ATOM_WINDOW, 32, 1, &ewmh_check_window
   );
-  log_msg(
-      LOG_LEVEL_INFO, "screen.width_in_pixels = %d",
-      screen->width_in_pixels
+  /* Only what's actually kept up to date */
+  xcb_atom_t supported[] = {
+    _NET_SUPPORTED, _NET_SUPPORTING_WM_CHECK, _NET_WM_NAME,
+    _NET_CLIENT_LIST, _NET_ACTIVE_WINDOW
+  };
+  xcb_change_property(
+      connection, XCB_PROP_MODE_REPLACE, root, _NET_SUPPORTED, XCB_ATOM_ATOM,
+      32, sizeof(supported)/sizeof(supported[0]), supported
   );
-  log_msg(
-      LOG_LEVEL_INFO, "screen.height_in_pixels = %d",
-      screen->height_in_pixels
+  /* Clear out whatever the last WM left, adopted windows come later */
+  ewmh_outdated = true;
+}
+static void update_ewmh(void) {
+  ewmh_outdated = false;
+  publish_root_property(
+      _NET_CLIENT_LIST, XCB_ATOM_WINDOW, &ewmh_client_list_shadow,
+      ewmh_clients, num_ewmh_clients
+  );
+  uint32_t active = focused ? focused->window : XCB_NONE;
+  publish_root_property(
+      _NET_ACTIVE_WINDOW, XCB_ATOM_WINDOW, &ewmh_active_window_shadow,
+      &active, 1
   );
 }
-static void eventloop(void) {
-  xcb_generic_event_t *event = xcb_wait_for_event(connection);
-  uint8_t type = event->response_type & ~0x80;
-  if (type < (sizeof(EVENT_HANDLERS)/sizeof(EVENT_HANDLERS[0])))
-    if (EVENT_HANDLERS[type])
-      EVENT_HANDLERS[type](event);
-  free(event);
+static void cleanup_ewmh(void) {
+  free(ewmh_clients);
+  free(ewmh_client_list_shadow.values);
+  free(ewmh_active_window_shadow.values);
+  ewmh_clients = NULL;
+  num_ewmh_clients = 0;
+  ewmh_clients_capacity = 0;
+  ewmh_client_list_shadow = (ewmh_shadow_t){ 0 };
+  ewmh_active_window_shadow = (ewmh_shadow_t){ 0 };
 }
-
-/* Manipulating windows */
-static void set_event_mask(xcb_window_t window, uint32_t event_mask) {
-  xcb_generic_error_t *error = NULL;
-  xcb_void_cookie_t cookie = xcb_change_window_attributes(
-      connection, window, XCB_CW_EVENT_MASK, &event_mask
-  );
-  error = xcb_request_check(connection, cookie);
-  if (error) {
-    int error_code = error->error_code;
-    free(error);
-    log_msg(
-        LOG_LEVEL_ERROR,
-        "Failed to change event mask of window %d (%d)",
-        (int)window, error_code
+static void list_ewmh_client(const client_t *client) {
+  if (num_ewmh_clients == ewmh_clients_capacity) {
+    uint32_t capacity = ewmh_clients_capacity ? ewmh_clients_capacity*2 : 64;
+    xcb_window_t *clients =
+      realloc(ewmh_clients, sizeof(xcb_window_t)*capacity);
+    if (!clients) LOG_ERROR("Failed to allocate client list");
+    ewmh_clients = clients;
+    ewmh_clients_capacity = capacity;
+  }
+  ewmh_clients[num_ewmh_clients++] = client->window;
+  ewmh_outdated = true;
+}
+static void unlist_ewmh_client(const client_t *client) {
+  /* Removing from the end is the common case, as windows come and go */
+  for (uint32_t i = num_ewmh_clients; i-- > 0;) {
+    if (ewmh_clients[i] != client->window) continue;
+    memmove(
+        &ewmh_clients[i], &ewmh_clients[i + 1],
+        sizeof(xcb_window_t)*(num_ewmh_clients - i - 1)
     );
+    num_ewmh_clients--;
+    ewmh_outdated = true;
+    return;
   }
 }
-static void set_window_rect(
-    xcb_window_t window, uint16_t x, uint16_t y, uint16_t width, uint16_t height
-);
+static void publish_root_property(
+    xcb_atom_t property, xcb_atom_t type, ewmh_shadow_t *shadow,
+    const uint32_t *values, uint32_t length
+) {
+  /*
+   * Unchanged properties aren't written at all. One that only grew, like the
+   * client list when windows are mapped, gets just its new tail appended
+   */
+  uint32_t kept = shadow->length < length ? shadow->length : length;
+  bool prefix = shadow->written
+    && (!kept || !memcmp(shadow->values, values, sizeof(uint32_t)*kept));
+  if (prefix && shadow->length == length) return;
+  if (length > shadow->capacity) {
+    uint32_t *shadow_values = realloc(shadow->values, sizeof(uint32_t)*length);
+    if (!shadow_values) LOG_ERROR("Failed to allocate property shadow");
+    shadow->values = shadow_values;
+    shadow->capacity = length;
+  }
+  if (prefix && kept == shadow->length) {
+    xcb_change_property(
+        connection, XCB_PROP_MODE_APPEND, root, property, type, 32,
+        length - kept, values + kept
+    );
+  } else {
+    xcb_change_property(
+        connection, XCB_PROP_MODE_REPLACE, root, property, type, 32,
+        length, values
+    );
+  }
+  if (length) memcpy(shadow->values, values, sizeof(uint32_t)*length);
+  shadow->length = length;
+  shadow->written = true;
+}
 
 /* Keyboard */
 static struct xkb_context *create_xkb_context(void) {
   return xkb_context_new(XKB_CONTEXT_NO_FLAGS);
 }
+static void setup_xkb_extension(void) {
+  if (!xkb_x11_setup_xkb_extension(
+        connection,
+        XKB_X11_MIN_MAJOR_XKB_VERSION, XKB_X11_MIN_MINOR_XKB_VERSION,
+        XKB_X11_SETUP_XKB_EXTENSION_NO_FLAGS,
+        NULL, NULL, &xkb_event_base, NULL
+  ))
+    LOG_ERROR("Failed to set up XKB extension");
+  xkb_device = xkb_x11_get_core_keyboard_device_id(connection);
+  if (xkb_device < 0)
+    LOG_ERROR("Failed to get core keyboard device");
+}
+static void select_xkb_events(void) {
+  const uint16_t map_parts =
+    XCB_XKB_MAP_PART_KEY_TYPES
+    | XCB_XKB_MAP_PART_KEY_SYMS
+    | XCB_XKB_MAP_PART_MODIFIER_MAP
+    | XCB_XKB_MAP_PART_EXPLICIT_COMPONENTS
+    | XCB_XKB_MAP_PART_KEY_ACTIONS
+    | XCB_XKB_MAP_PART_VIRTUAL_MODS
+    | XCB_XKB_MAP_PART_VIRTUAL_MOD_MAP;
+  const uint16_t state_parts =
+    XCB_XKB_STATE_PART_MODIFIER_BASE
+    | XCB_XKB_STATE_PART_MODIFIER_LATCH
+    | XCB_XKB_STATE_PART_MODIFIER_LOCK
+    | XCB_XKB_STATE_PART_GROUP_BASE
+    | XCB_XKB_STATE_PART_GROUP_LATCH
+    | XCB_XKB_STATE_PART_GROUP_LOCK;
+  const xcb_xkb_select_events_details_t details = {
+    .affectNewKeyboard = XCB_XKB_NKN_DETAIL_KEYCODES,
+    .newKeyboardDetails = XCB_XKB_NKN_DETAIL_KEYCODES,
+    .affectState = state_parts,
+    .stateDetails = state_parts
+  };
+  xcb_void_cookie_t cookie = xcb_xkb_select_events_aux_checked(
+      connection, xkb_device,
+      XCB_XKB_EVENT_TYPE_NEW_KEYBOARD_NOTIFY
+      | XCB_XKB_EVENT_TYPE_MAP_NOTIFY
+      | XCB_XKB_EVENT_TYPE_STATE_NOTIFY,
+      0, 0,
+      map_parts, map_parts,
+      &details
+  );
+  STATS_ROUND_TRIP();
+  xcb_generic_error_t *error = xcb_request_check(connection, cookie);
+  if (error) {
+    int error_code = error->error_code;
+    free(error);
+    LOG_ERROR("Failed to select XKB events (%d)", error_code);
+  }
+}
+static void update_xkb_keymap(void) {
+  xkb_keymap_outdated = false;
+  /* Each of these pipelines its requests, then waits on all the replies */
+  STATS_ROUND_TRIP();
+  struct xkb_keymap *keymap = xkb_x11_keymap_new_from_device(
+      xkb_context, connection, xkb_device, XKB_KEYMAP_COMPILE_NO_FLAGS
+  );
+  if (!keymap) {
+    LOG_WARNING("Failed to get new keymap, keeping old one");
+    return;
+  }
+  STATS_ROUND_TRIP();
+  struct xkb_state *state =
+    xkb_x11_state_new_from_device(keymap, connection, xkb_device);
+  if (!state) {
+    xkb_keymap_unref(keymap);
+    LOG_WARNING("Failed to get new keymap, keeping old one");
+    return;
+  }
+  unref_xkb_state();
+  unref_xkb_keymap();
+  xkb_keymap = keymap;
+  xkb_state = state;
+  LOG_INFO("Keymap changed, rebinding keymaps");
+  apply_keymaps(keymaps, num_keymaps, false);
+  update_modifier_keys();
+}
 static struct xkb_keymap *create_xkb_keymap(void) {
-  return xkb_keymap_new_from_names(
-      xkb_context, NULL, XKB_KEYMAP_COMPILE_NO_FLAGS
+  struct xkb_keymap *keymap = xkb_x11_keymap_new_from_device(
+      xkb_context, connection, xkb_device, XKB_KEYMAP_COMPILE_NO_FLAGS
   );
+  if (!keymap)
+    LOG_ERROR("Failed to get keymap");
+  return keymap;
 }
 static struct xkb_state *create_xkb_state(void) {
-  return xkb_state_new(xkb_keymap);
+  struct xkb_state *state =
+    xkb_x11_state_new_from_device(xkb_keymap, connection, xkb_device);
+  if (!state)
+    LOG_ERROR("Failed to get keyboard state");
+  return state;
 }
 static void unref_xkb_context(void) {
   xkb_context_unref(xkb_context);
@@ -178,12 +2210,138 @@ static void unref_xkb_keymap(void) {
 static void unref_xkb_state(void) {
   xkb_state_unref(xkb_state);
 }
-static void grab_keymap(uint16_t modifiers, xkb_keysym_t keysym) {
+static void resolve_keymaps(
+    const keymap_t *keymaps, uint32_t num_keymaps, xkb_keycode_t *keycodes
+) {
+  /* Sort keymaps by keysym, so each key's keysyms can be binary searched */
+  uint32_t *order = arena_alloc(&pass_arena, sizeof(uint32_t)*num_keymaps);
+  for (uint32_t i = 0; i < num_keymaps; i++) {
+    order[i] = i;
+    keycodes[i] = XKB_KEYCODE_INVALID;
+  }
+  sorting_keymaps = keymaps;
+  qsort(order, num_keymaps, sizeof(order[0]), compare_keymap_keysyms);
+
+  /* A single pass over the keyboard finds the first keycode of each keysym */
+  xkb_keycode_t min = xkb_keymap_min_keycode(xkb_keymap);
+  xkb_keycode_t max = xkb_keymap_max_keycode(xkb_keymap);
+  for (xkb_keycode_t keycode = min; keycode <= max && keycode < 256; keycode++) {
+    const xkb_keysym_t *keysyms;
+    int num_keysyms =
+      xkb_keymap_key_get_syms_by_level(xkb_keymap, keycode, 0, 0, &keysyms);
+    for (int j = 0; j < num_keysyms; j++) {
+      uint32_t low = 0, high = num_keymaps;
+      while (low < high) {
+        uint32_t middle = low + (high - low)/2;
+        if (keymaps[order[middle]].keysym < keysyms[j]) low = middle + 1;
+        else high = middle;
+      }
+      for (; low < num_keymaps && keymaps[order[low]].keysym == keysyms[j]; low++)
+        if (keycodes[order[low]] == XKB_KEYCODE_INVALID)
+          keycodes[order[low]] = keycode;
+    }
+  }
+}
+static void apply_keymaps(
+    const keymap_t *new_keymaps, uint32_t num_new_keymaps, bool checked
+) {
+  /*
+   * Used for the first binding, keyboard changes and config reloads alike.
+   * The new lookup table is built in full, then grabs are diffed against the
+   * old one: only combinations that appear or disappear are sent, so nothing
+   * the two share is ever ungrabbed, even for a moment. When two keymaps
+   * share a combination the later one wins, and only it is grabbed. Past
+   * startup the grabs go out unchecked like any other event-time request
+   */
+  xkb_keycode_t *keycodes =
+    malloc(sizeof(xkb_keycode_t)*(num_new_keymaps ? num_new_keymaps : 1));
+  if (!keycodes) LOG_ERROR("Failed to allocate %u keymaps", num_new_keymaps);
+  resolve_keymaps(new_keymaps, num_new_keymaps, keycodes);
+  uint16_t (*old_lookup)[KEYMAP_MODIFIERS + 1] = keymap_lookup;
+  uint16_t (*lookup)[KEYMAP_MODIFIERS + 1] =
+    keymap_lookup == keymap_tables[0] ? keymap_tables[1] : keymap_tables[0];
+  memset(lookup, 0, sizeof(keymap_table_t));
+  for (uint32_t i = 0; i < num_new_keymaps; i++) {
+    if (keycodes[i] == XKB_KEYCODE_INVALID) {
+      LOG_WARNING("Couldn't find keysym %d", new_keymaps[i].keysym);
+      continue;
+    }
+    lookup[keycodes[i]][new_keymaps[i].modifiers & KEYMAP_MODIFIERS] = i + 1;
+  }
+
+  for (uint32_t i = 0; keymap_keycodes && i < num_keymaps; i++) {
+    xkb_keycode_t keycode = keymap_keycodes[i];
+    if (keycode == XKB_KEYCODE_INVALID) continue;
+    uint16_t modifiers = keymaps[i].modifiers;
+    if (old_lookup[keycode][modifiers & KEYMAP_MODIFIERS] != i + 1) continue;
+    if (lookup[keycode][modifiers & KEYMAP_MODIFIERS]) continue;
+    xcb_ungrab_key(connection, (xcb_keycode_t)keycode, root, modifiers);
+  }
+  xcb_void_cookie_t *cookies = checked
+    ? arena_alloc(&pass_arena, sizeof(xcb_void_cookie_t)*num_new_keymaps)
+    : NULL;
+  uint32_t num_cookies = 0;
+  for (uint32_t i = 0; i < num_new_keymaps; i++) {
+    xkb_keycode_t keycode = keycodes[i];
+    if (keycode == XKB_KEYCODE_INVALID) continue;
+    uint16_t modifiers = new_keymaps[i].modifiers;
+    if (lookup[keycode][modifiers & KEYMAP_MODIFIERS] != i + 1) continue;
+    if (keymap_keycodes && old_lookup[keycode][modifiers & KEYMAP_MODIFIERS])
+      continue;
+    xcb_void_cookie_t cookie =
+      grab_keymap(modifiers, new_keymaps[i].keysym, keycode, checked);
+    if (checked) cookies[num_cookies++] = cookie;
+  }
+
+  /* Swap everything in at once */
+  keymap_lookup = lookup;
+  keymaps = new_keymaps;
+  num_keymaps = num_new_keymaps;
+  free(keymap_keycodes);
+  keymap_keycodes = keycodes;
+
+  /* Every grab is sent before checking any of them */
+  if (!checked) return;
+  STATS_ROUND_TRIP();
+  for (uint32_t i = 0; i < num_cookies; i++) {
+    xcb_generic_error_t *error = xcb_request_check(connection, cookies[i]);
+    if (error) {
+      int error_code = error->error_code;
+      free(error);
+      LOG_ERROR("Failed to grab keys: (%d)", error_code);
+    }
+  }
+}
+static int compare_keymap_keysyms(const void *a, const void *b) {
+  xkb_keysym_t keysym_a = sorting_keymaps[*(const uint32_t *)a].keysym;
+  xkb_keysym_t keysym_b = sorting_keymaps[*(const uint32_t *)b].keysym;
+  return (keysym_a > keysym_b) - (keysym_a < keysym_b);
+}
+static void update_modifier_keys(void) {
+  /* Press each key on a scratch state to see which modifiers it sets */
+  memset(modifier_keys, 0, sizeof(modifier_keys));
+  struct xkb_state *state = xkb_state_new(xkb_keymap);
+  if (!state) return;
+  xkb_keycode_t max = xkb_keymap_max_keycode(xkb_keymap);
+  if (max > 255) max = 255;
+  for (xkb_keycode_t key = xkb_keymap_min_keycode(xkb_keymap); key <= max;
+      key++) {
+    xkb_state_update_key(state, key, XKB_KEY_DOWN);
+    modifier_keys[key] =
+      xkb_state_serialize_mods(state, XKB_STATE_MODS_DEPRESSED)
+      & KEYMAP_MODIFIERS;
+    xkb_state_update_key(state, key, XKB_KEY_UP);
+  }
+  xkb_state_unref(state);
+}
+static xcb_void_cookie_t grab_keymap(
+    uint16_t modifiers, xkb_keysym_t keysym, xkb_keycode_t keycode,
+    bool checked
+) {
   char keyname[64];
   if (xkb_keysym_get_name(keysym, keyname, sizeof(keyname)) < 0)
     memcpy(keyname, "???\0", 4);
-  log_msg(
-      LOG_LEVEL_INFO,
+  LOG_INFO(
       "Grabbing combination %s%s%s%s%s%s%s%s%s",
       modifiers & XCB_MOD_MASK_SHIFT ? "Shift+" : "",
       modifiers & XCB_MOD_MASK_LOCK ? "Capslock+" : "",
@@ -195,41 +2353,129 @@ static void grab_keymap(uint16_t modifiers, xkb_keysym_t keysym) {
       modifiers & XCB_MOD_MASK_5 ? "AltGr+" : "",
       keyname
   );
-    
-  xkb_keycode_t xkb_keycode;
-  xkb_keycode_t min = xkb_keymap_min_keycode(xkb_keymap);
-  xkb_keycode_t max = xkb_keymap_max_keycode(xkb_keymap);
-  bool found = false;
-  for (xkb_keycode_t i = min; i <= max; i++) {
-    int num_keysyms;
-    const xkb_keysym_t *keysyms;
-    num_keysyms =
-      xkb_keymap_key_get_syms_by_level(xkb_keymap, i, 0, 0, &keysyms);
-    for (int j = 0; j < num_keysyms; j++) {
-      if (keysyms[j] == keysym) {
-        found = true;
-        xkb_keycode = i;
-      }
-    }
-  }
-  if (!found) log_msg(LOG_LEVEL_ERROR, "Couldn't find keysym %d", keysym);
-
-  xcb_keycode_t keycode = (xcb_keycode_t)xkb_keycode;
-  xcb_generic_error_t *error = NULL;
-  xcb_void_cookie_t cookie = xcb_grab_key(
+  return (checked ? xcb_grab_key_checked : xcb_grab_key)(
       connection,
       0,
       root,
-      modifiers, keycode,
+      modifiers, (xcb_keycode_t)keycode,
       XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC
   );
-  error = xcb_request_check(connection, cookie);
-  if (error) {
-    int error_code = error->error_code;
-    free(error);
-    log_msg(LOG_LEVEL_ERROR, "Failed to grab keys: (%d)", error_code
+}
+
+/* Runtime config */
+static void setup_config(void) {
+  config_file_path(config_path, sizeof(config_path));
+  /* The directory is watched, since editors often replace files by renaming */
+  char directory[PATH_MAX];
+  snprintf(directory, sizeof(directory), "%s", config_path);
+  char *slash = strrchr(directory, '/');
+  if (!slash) snprintf(directory, sizeof(directory), ".");
+  else if (slash == directory) slash[1] = '\0';
+  else *slash = '\0';
+  config_watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (config_watch_fd >= 0 && inotify_add_watch(
+        config_watch_fd, directory,
+        IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE
+      ) >= 0) {
+    loop_watch(config_watch_fd, EPOLLIN, handle_config_watch_fd, NULL);
+  } else {
+    LOG_INFO("Not watching %s for changes (%s)", directory, strerror(errno));
+    if (config_watch_fd >= 0) close(config_watch_fd);
+    config_watch_fd = -1;
+  }
+
+  /* Without a usable file, the compiled in keymaps are bound */
+  if (!access(config_path, F_OK) && config_file_load(
+        config_path, CONFIG_COMMAND_NAMES, NUM_CONFIG_COMMANDS, &config
+      )) {
+    LOG_INFO(
+        "Loaded %u bindings and %u rules from %s",
+        config.num_bindings, config.num_rules, config_path
     );
+    config_keymaps = compile_config(&config);
+    apply_keymaps(config_keymaps, config.num_bindings, true);
+    rules = compile_rules(&config);
+  } else {
+    apply_keymaps(_KEYMAPS, NUM_KEYMAPS, true);
+    rules = compile_rules(NULL);
+  }
+}
+static void reload_config(void) {
+  /*
+   * Only the bindings and rules change, never any window state, so rules
+   * apply to windows mapped from now on. A file that fails to parse keeps
+   * the current ones, and a deleted one brings back the compiled in ones
+   */
+  config_outdated = false;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  config_t new_config = { 0 };
+  keymap_t *new_keymaps = NULL;
+  if (!access(config_path, F_OK)) {
+    if (!config_file_load(
+          config_path, CONFIG_COMMAND_NAMES, NUM_CONFIG_COMMANDS, &new_config
+        )) {
+      LOG_WARNING("Keeping the current bindings and rules");
+      return;
+    }
+    new_keymaps = compile_config(&new_config);
+  }
+  if (new_keymaps)
+    apply_keymaps(new_keymaps, new_config.num_bindings, false);
+  else
+    apply_keymaps(_KEYMAPS, NUM_KEYMAPS, false);
+  rules_free(rules);
+  rules = compile_rules(new_keymaps ? &new_config : NULL);
+  /* Nothing points into the old config any more */
+  config_file_free(&config);
+  free(config_keymaps);
+  config = new_config;
+  config_keymaps = new_keymaps;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  LOG_INFO(
+      "Reloaded %u bindings and %u rules in %ldus", num_keymaps,
+      rules_count(rules),
+      (long)((end.tv_sec - start.tv_sec)*1000000
+        + (end.tv_nsec - start.tv_nsec)/1000)
+  );
+}
+static keymap_t *compile_config(const config_t *config) {
+  keymap_t *compiled =
+    malloc(sizeof(keymap_t)*(config->num_bindings ? config->num_bindings : 1));
+  if (!compiled)
+    LOG_ERROR("Failed to allocate %u keymaps", config->num_bindings);
+  for (uint32_t i = 0; i < config->num_bindings; i++) {
+    const config_binding_t *binding = &config->bindings[i];
+    compiled[i] = (keymap_t){
+      .modifiers = binding->modifiers,
+      .keysym = binding->keysym,
+      .handler = CONFIG_HANDLERS[binding->command]
+    };
+    switch (CONFIG_COMMAND_NAMES[binding->command].arg) {
+      case CONFIG_ARG_INT:
+        compiled[i].data.i32 = binding->arg.i32;
+        break;
+      case CONFIG_ARG_ARGV:
+        compiled[i].data.ptr = binding->arg.argv;
+        break;
+      case CONFIG_ARG_NONE:
+        break;
+    }
   }
+  return compiled;
+}
+static void cleanup_config(void) {
+  if (config_watch_fd >= 0) close(config_watch_fd);
+  config_watch_fd = -1;
+  config_file_free(&config);
+  free(config_keymaps);
+  config_keymaps = NULL;
+  rules_free(rules);
+  rules = NULL;
+  free(keymap_keycodes);
+  keymap_keycodes = NULL;
+  keymaps = _KEYMAPS;
+  num_keymaps = NUM_KEYMAPS;
 }
 
 /* Keymap handlers */
@@ -238,71 +2484,405 @@ static void handle_keymap_quit(
 ) {
   running = false;
 }
+static void handle_keymap_restart(
+    xcb_key_press_event_t *event, keymap_data_t data
+) {
+  LOG_INFO("Restarting");
+  restarting = true;
+  running = false;
+}
 static void handle_keymap_destroy(
     xcb_key_press_event_t *event, keymap_data_t data
 ) {
-  xcb_generic_error_t *error = NULL;
+  client_t *client = keymap_target(event);
+  xcb_window_t window = client ? client->window
+    : event->event != root ? event->event : XCB_NONE;
+  if (!window) return;
   const xcb_client_message_event_t wm_event = {
     .response_type = XCB_CLIENT_MESSAGE,
     .format = 32,
-    .window = event->child,
+    .window = window,
     .type = WM_PROTOCOLS,
     .data.data32 = { WM_DELETE_WINDOW, XCB_CURRENT_TIME, 0, 0, 0 }
   };
-  xcb_void_cookie_t cookie = xcb_send_event(
+  xcb_send_event(
       connection,
-      0, event->child,
+      0, window,
       XCB_EVENT_MASK_NO_EVENT,
       (const char *)&wm_event
   );
-  error = xcb_request_check(connection, cookie);
-  if (error) {
-    int error_code = error->error_code;
-    free(error);
-    log_msg(
-        LOG_LEVEL_ERROR,
-        "Failed to send WM_DELETE_WINDOW event (%d)", error_code
-    );
-  }
 }
 static void handle_keymap_spawnprocess(
     xcb_key_press_event_t *event, keymap_data_t data
 ) {
-  if (!fork()) {
-    int devnull = open("/dev/null", O_WRONLY);
-    if (devnull < 0)
-      log_msg(
-          LOG_LEVEL_ERROR,
-          "Failed to open /dev/null (%s)", strerror(errno)
+  launcher_spawn((char *const *)data.ptr);
+}
+static void handle_keymap_move(
+    xcb_key_press_event_t *event, keymap_data_t data
+) {
+  const rect_t *rect = data.ptr;
+  client_t *client = keymap_target(event);
+  if (!client) return;
+  /* Moved clients float until they're tiled again */
+  if (!client->floating && client->mapped)
+    mark_workspace(client->output, client->workspace);
+  client->floating = true;
+  if (!rect_equal(client->sent, *rect)) send_client_rect(client, *rect);
+}
+static void handle_keymap_tile(
+    xcb_key_press_event_t *event, keymap_data_t data
+) {
+  client_t *client = keymap_target(event);
+  if (!client || !client->floating) return;
+  client->floating = false;
+  if (client->mapped) mark_workspace(client->output, client->workspace);
+}
+
+static void handle_keymap_cycle(
+    xcb_key_press_event_t *event, keymap_data_t data
+) {
+  if (!cycling) {
+    client_t *start = focused && focused->in_focus_order
+      && client_visible(focused) ? focused : recent_visible_client();
+    if (!start) return;
+    /*
+     * Hold the keyboard so letting go of the binding's modifiers reaches pwm
+     * wherever focus is. Without any, each press moves focus straight away
+     */
+    cycle_modifiers = event->state & KEYMAP_MODIFIERS & ~(SHIFT | LOCK);
+    cycle_candidate = start;
+    if (cycle_modifiers) {
+      /*
+       * Waited for, once per cycle. Without the grab the release could go
+       * to whoever holds the keyboard, and the cycle would never end
+       */
+      xcb_grab_keyboard_cookie_t cookie = xcb_grab_keyboard(
+          connection, 0, root, XCB_CURRENT_TIME,
+          XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC
       );
-    dup2(devnull, STDOUT_FILENO);
-    dup2(devnull, STDERR_FILENO);
-    close(devnull);
+      STATS_ROUND_TRIP();
+      xcb_grab_keyboard_reply_t *grab =
+        xcb_grab_keyboard_reply(connection, cookie, NULL);
+      cycling = grab && grab->status == XCB_GRAB_STATUS_SUCCESS;
+      free(grab);
+      if (cycling) mark_decoration(focused);
+    }
+  }
+  if (!cycle_candidate) return;
+  /* Walking the focus order never needs the window tree */
+  mark_decoration(cycle_candidate);
+  client_t *candidate = cycle_candidate;
+  for (uint32_t i = 0; i < focus_order.count; i++) {
+    if (data.i32 >= 0)
+      candidate = candidate->focus_next
+        ? candidate->focus_next : focus_order.head;
+    else
+      candidate = candidate->focus_prev
+        ? candidate->focus_prev : focus_order.tail;
+    /* Clients on hidden workspaces are skipped over */
+    if (client_visible(candidate)) break;
+  }
+  cycle_candidate = candidate;
+  mark_decoration(cycle_candidate);
+  if (!cycling) end_cycle();
+}
+static void handle_keymap_view(
+    xcb_key_press_event_t *event, keymap_data_t data
+) {
+  /* Workspaces count from 1, on the output of the window acted on */
+  if (data.i32 < 1 || data.i32 > WORKSPACES) return;
+  client_t *client = keymap_target(event);
+  view_workspace(client ? client->output : current_output, data.i32 - 1);
+}
+static void handle_keymap_send(
+    xcb_key_press_event_t *event, keymap_data_t data
+) {
+  if (data.i32 < 1 || data.i32 > WORKSPACES) return;
+  client_t *client = keymap_target(event);
+  if (client && client->mapped) send_to_workspace(client, data.i32 - 1);
+}
+static void handle_keymap_layout(
+    xcb_key_press_event_t *event, keymap_data_t data
+) {
+  if (data.i32 < 0 || data.i32 >= NUM_LAYOUTS) return;
+  client_t *client = keymap_target(event);
+  uint32_t o = client ? client->output : current_output;
+  workspace_t *workspace = &outputs[o].workspaces[outputs[o].workspace];
+  if (workspace->layout == (layout_t)data.i32) return;
+  workspace->layout = data.i32;
+  LOG_INFO("Workspace layout is now %s", LAYOUT_NAMES[data.i32]);
+  mark_workspace(o, outputs[o].workspace);
+}
+static client_t *keymap_target(const xcb_key_press_event_t *event) {
+  /* Key bindings act on the focused client, IPC commands say which */
+  return event->event == root ? focused : client_find(event->event);
+}
 
-    execvp(((char **)data.ptr)[0], ((char **)data.ptr));
+/* IPC */
+static void setup_ipc(void) {
+  char path[108];
+  ipc_socket_path(path, sizeof(path));
+  /* Not being scriptable isn't a reason to not manage windows */
+  ipc_init(path, handle_ipc_command);
+}
+static void handle_ipc_command(
+    ipc_client_t *client, const ipc_command_t *command
+) {
+  if (command->op == IPC_OP_CLIENTS) {
+    reply_ipc_clients(client);
+    return;
+  }
+  if (command->op == IPC_OP_STATS) {
+    char buffer[8192];
+    ipc_reply(client, buffer, format_stats(buffer, sizeof(buffer)));
+    return;
+  }
+  if (command->op == IPC_OP_RELOAD) {
+    config_outdated = true;
+    return;
+  }
+  if (command->op == IPC_OP_BAR) {
+    set_bar_block(command->argv[0], command->argv + 1);
+    return;
   }
+  if (!IPC_HANDLERS[command->op]) return;
+  /* Window 0 means whichever window has focus, like a key binding */
+  xcb_window_t window = command->window ? command->window : root;
+  xcb_key_press_event_t event = {
+    .response_type = XCB_KEY_PRESS,
+    .time = XCB_CURRENT_TIME,
+    .root = root,
+    .event = window,
+    .child = window
+  };
+  rect_t rect = {
+    command->values[0], command->values[1],
+    command->values[2], command->values[3]
+  };
+  keymap_data_t data = { .i32 = 0 };
+  if (command->op == IPC_OP_VIEW || command->op == IPC_OP_SEND)
+    data.i32 = command->values[0];
+  else if (command->op == IPC_OP_MOVE) data.ptr = &rect;
+  else if (command->op == IPC_OP_SPAWN) data.ptr = (void *)command->argv;
+  IPC_HANDLERS[command->op](&event, data);
+}
+static void reply_ipc_clients(ipc_client_t *client) {
+  /*
+   * Binary: op, count, then window, output and rectangle per client. Text: a
+   * line per client and an empty one. Either is sent as one reply, since a
+   * reply that doesn't fit drops the client
+   */
+  uint32_t size = 5 + client_count()*IPC_CLIENT_LINE_SIZE + 1;
+  char *reply = arena_alloc(&pass_arena, size);
+  uint32_t length = 0;
+  uint32_t count = 0;
+  bool binary = ipc_binary(client);
+  if (binary) {
+    reply[0] = IPC_OP_CLIENTS;
+    length = 5;
+  }
+  for (uint32_t o = 0; o < num_outputs; o++) {
+    for (uint32_t w = 0; w < WORKSPACES; w++) {
+      const client_list_t *clients = &outputs[o].workspaces[w].clients;
+      for (const client_t *c = clients->head; c; c = c->next) {
+        if (binary) {
+          memcpy(reply + length, &c->window, 4);
+          memcpy(reply + length + 4, &o, 4);
+          memcpy(reply + length + 8, &c->sent, 8);
+          length += 16;
+        } else {
+          length += snprintf(
+              reply + length, IPC_CLIENT_LINE_SIZE, "0x%x %u %d %d %u %u\n",
+              (unsigned)c->window, o, c->sent.x, c->sent.y, c->sent.width,
+              c->sent.height
+          );
+        }
+        count++;
+      }
+    }
+  }
+  if (binary) memcpy(reply + 1, &count, 4);
+  else reply[length++] = '\n';
+  ipc_reply(client, reply, length);
+}
+static void publish_ipc_event(ipc_event_t event, const client_t *client) {
+  static const char *names[] = {
+    [IPC_EVENT_MAP] = "map", [IPC_EVENT_UNMAP] = "unmap",
+    [IPC_EVENT_FOCUS] = "focus"
+  };
+  /* Binary: event op, event and window */
+  char data[9] = { IPC_OP_EVENT };
+  uint32_t window = client ? client->window : XCB_NONE;
+  memcpy(data + 1, &event, 4);
+  memcpy(data + 5, &window, 4);
+  char text[32];
+  snprintf(text, sizeof(text), "%s 0x%x\n", names[event], (unsigned)window);
+  ipc_publish(event, data, sizeof(data), text);
+}
+
+/* Stats */
+static void dump_stats(int fd) {
+  char buffer[8192];
+  size_t length = format_stats(buffer, sizeof(buffer));
+  /* One write, so it doesn't interleave with the log writer */
+  if (write(fd, buffer, length) < 0)
+    LOG_WARNING("Failed to write stats (%s)", strerror(errno));
+}
+static size_t format_stats(char *buffer, size_t size) {
+  /* Handler timings when built with them, allocator counters always */
+  size_t length = stats_format(buffer, size, get_event_name);
+  if (length < size)
+    length += arena_format(
+        buffer + length, size - length, "pass arena", &pass_arena
+    );
+  if (length < size)
+    length += pool_format(
+        buffer + length, size - length, "clients", client_pool()
+    );
+  if (length < size)
+    length += pool_format(
+        buffer + length, size - length, "ipc clients", ipc_client_pool()
+    );
+  if (length < size) length += render_format(buffer + length, size - length);
+  return length < size ? length : size - 1;
+}
+static const char *get_event_name(uint32_t type) {
+  if (xkb_event_base && type == xkb_event_base) return "XKB";
+  if (randr_event_base && type == randr_event_base) return "RANDR";
+  if (type < sizeof(EVENT_NAMES)/sizeof(EVENT_NAMES[0]))
+    return EVENT_NAMES[type];
+  return NULL;
 }
 
 /* XCB handlers */
+static void handle_xcb_error(xcb_error_event_t *event) {
+  /*
+   * Errors from unchecked requests end up here rather than stalling the
+   * request path. Windows can disappear between a request being queued and the
+   * server processing it, so these aren't fatal
+   */
+  LOG_WARNING(
+      "X error %d on request %d.%d (resource %d, sequence %d)",
+      event->error_code, event->major_code, event->minor_code,
+      (int)event->resource_id, event->sequence
+  );
+  /* A client that went while nobody was listening, like during a restart */
+  client_t *client = event->error_code == XCB_WINDOW
+    ? client_find(event->resource_id) : NULL;
+  if (client && client->window == event->resource_id) unmanage_client(client);
+}
 static void handle_xcb_create_notify(xcb_create_notify_event_t *event) { }
-static void handle_xcb_destroy_notify(xcb_destroy_notify_event_t *event) { }
+static void handle_xcb_destroy_notify(xcb_destroy_notify_event_t *event) {
+  client_t *client = client_find(event->window);
+  if (client) unmanage_client(client);
+}
 static void handle_xcb_map_notify(xcb_map_notify_event_t *event) { }
-static void handle_xcb_unmap_notify(xcb_unmap_notify_event_t *event) { }
+static void handle_xcb_unmap_notify(xcb_unmap_notify_event_t *event) {
+  /* Frames only get unmapped by pwm itself */
+  client_t *client = client_find(event->window);
+  if (!client || event->window != client->window) return;
+  /*
+   * A hidden or iconic client is already unmapped, so withdrawing only shows
+   * up as the synthetic unmap ICCCM 4.1.4 has it send to the root
+   */
+  bool withdrawn = (client->hidden || !client->mapped)
+    && event->response_type & 0x80 && event->event == root;
+  if (!client->mapped && !withdrawn) return;
+  /* Reparenting a mapped window unmaps it from the root first */
+  if (event->event != client->frame && !withdrawn) return;
+  /*
+   * Unmaps pwm sent itself carry the sequence number of the request, so they
+   * can be told apart without asking the server. Everything up to the last
+   * one is pwm's, in case a workspace was hidden more than once in a pass
+   */
+  if (!withdrawn && client->unmap_pending
+      && (int16_t)(event->sequence - client->unmap_sequence) <= 0) {
+    if (event->sequence == client->unmap_sequence)
+      client->unmap_pending = false;
+    return;
+  }
+  release_client(client);
+}
 static void handle_xcb_reparent_notify(xcb_reparent_notify_event_t *event) { }
-static void handle_xcb_configure_notify(xcb_configure_notify_event_t *event) { }
+static void handle_xcb_configure_notify(xcb_configure_notify_event_t *event) {
+  client_t *client = client_find(event->window);
+  if (!client || event->window != client->frame) return;
+  client->geometry = (rect_t){
+    event->x, event->y,
+    event->width + 2*event->border_width,
+    event->height + 2*event->border_width
+  };
+}
 static void handle_xcb_gravity_notify(xcb_gravity_notify_event_t *event) { }
+static void handle_xcb_expose(xcb_expose_event_t *event) {
+  /* Whatever was covered is still in the pixmap, nothing is drawn again */
+  for (uint32_t o = 0; o < num_outputs; o++) {
+    if (!outputs[o].bar_window || outputs[o].bar_window != event->window)
+      continue;
+    xcb_copy_area(
+        connection, outputs[o].bar_pixmap, event->window, bar_gc,
+        event->x, event->y, event->x, event->y, event->width, event->height
+    );
+  }
+}
+static void handle_xcb_property_notify(xcb_property_notify_event_t *event) {
+  client_t *client = client_find(event->window);
+  if (!client || event->window != client->window) return;
+  client_property_t property = find_client_property(event->atom);
+  if (property == CLIENT_NUM_PROPERTIES) return;
+  /*
+   * A fetch already sent sees the change if the server made it first, which
+   * the event's sequence number, the last request it had read, tells
+   */
+  uint8_t bit = 1u << property;
+  if (!(client->properties_pending & bit))
+    request_properties(client, bit);
+  else if ((int16_t)(
+        event->sequence - client->property_cookies[property].sequence
+      ) >= 0)
+    client->properties_stale |= bit;
+}
 static void handle_xcb_map_request(xcb_map_request_event_t *event) {
-  log_msg(LOG_LEVEL_INFO, "Processing map request...");
-  xcb_void_cookie_t cookie = xcb_map_window(connection, event->window);
-  xcb_generic_error_t *error = xcb_request_check(connection, cookie);
-  if (error) {
-    log_msg(LOG_LEVEL_ERROR, "Failed to map window (%d)", error->error_code);
-    free(error);
+  LOG_INFO("Processing map request...");
+  client_t *client = manage_window(event->window);
+  if (!client->mapped) {
+    attach_client(client, focused ? focused->output : current_output);
+    client->needs_map = true;
+    focus_client(client);
   }
-  xcb_flush(connection);
 }
 static void handle_xcb_configure_request(xcb_configure_request_event_t *event) {
-  log_msg(LOG_LEVEL_INFO, "Processing configure request...");
+  LOG_INFO("Processing configure request...");
+
+  /* Tiled clients get told where they are instead (ICCCM 4.1.5) */
+  client_t *client = client_find(event->window);
+  if (client && client->mapped && !client->floating) {
+    /* Clients waiting on their first layout get a real configure soon */
+    if (!client->needs_map) send_configure_notify(client);
+    return;
+  }
+  /* Other clients get what they ask for, with their frame around it */
+  if (client) {
+    rect_t rect = client->sent;
+    if (event->value_mask & XCB_CONFIG_WINDOW_X)
+      rect.x = event->x - BORDER_WIDTH;
+    if (event->value_mask & XCB_CONFIG_WINDOW_Y)
+      rect.y = event->y - BORDER_WIDTH;
+    if (event->value_mask & XCB_CONFIG_WINDOW_WIDTH)
+      rect.width = event->width + 2*BORDER_WIDTH;
+    if (event->value_mask & XCB_CONFIG_WINDOW_HEIGHT)
+      rect.height = event->height + 2*BORDER_WIDTH;
+    if (!rect_equal(rect, client->sent)) send_client_rect(client, rect);
+    else send_configure_notify(client);
+    if (event->value_mask & XCB_CONFIG_WINDOW_STACK_MODE) {
+      uint32_t stack_mode = event->stack_mode;
+      xcb_configure_window(
+          connection, client->frame,
+          XCB_CONFIG_WINDOW_STACK_MODE, &stack_mode
+      );
+    }
+    return;
+  }
 
   uint32_t value_list[7];
   uint8_t num_values = 0;
@@ -321,28 +2901,91 @@ static void handle_xcb_configure_request(xcb_configure_request_event_t *event) {
   if (event->value_mask & XCB_CONFIG_WINDOW_STACK_MODE)
     value_list[num_values++] = event->stack_mode;
 
-  xcb_void_cookie_t cookie = xcb_configure_window(
+  xcb_configure_window(
       connection, event->window,
       event->value_mask, value_list
   );
-  xcb_generic_error_t *error = xcb_request_check(connection, cookie);
-  if (error) {
-    log_msg(
-        LOG_LEVEL_ERROR,
-        "Failed to configure window (%d)",
-        error->error_code
-    );
-    free(error);
-  }
-  xcb_flush(connection);
 }
 static void handle_xcb_circulate_request(xcb_circulate_request_event_t *event) { }
 static void handle_xcb_key_press(xcb_key_press_event_t *event) {
-  xkb_keysym_t keysym = xkb_state_key_get_one_sym(xkb_state, event->detail);
-  for (uint32_t i = 0; i < NUM_KEYMAPS; i++)
-    if ((event->state == _KEYMAPS[i].modifiers) && keysym == _KEYMAPS[i].keysym)
-      _KEYMAPS[i].handler(event, _KEYMAPS[i].data);
-}
-static void handle_xcb_key_release(xcb_key_release_event_t *event) { }
-static void handle_xcb_focus_in(xcb_focus_in_event_t *event) { }
-static void handle_xcb_focus_out(xcb_focus_out_event_t *event) { }
+  /* In case the release was missed, the modifiers being up ends it too */
+  if (cycling && !(event->state & cycle_modifiers)) end_cycle();
+  uint16_t index =
+    keymap_lookup[event->detail][event->state & KEYMAP_MODIFIERS];
+  if (index)
+    keymaps[index - 1].handler(event, keymaps[index - 1].data);
+}
+static void handle_xcb_key_release(xcb_key_release_event_t *event) {
+  if (cycling && modifier_keys[event->detail] & cycle_modifiers) end_cycle();
+}
+static void handle_xcb_button_press(xcb_button_press_event_t *event) {
+  /* The grab is on the root, and child is the frame under the pointer */
+  client_t *client = client_find(event->child);
+  if (drag.mode || !client || !client->mapped) return;
+  if (event->detail == MOVE_BUTTON) begin_drag(client, DRAG_MOVE, event);
+  else if (event->detail == RESIZE_BUTTON)
+    begin_drag(client, DRAG_RESIZE, event);
+}
+static void handle_xcb_button_release(xcb_button_release_event_t *event) {
+  if (!drag.mode || event->detail != drag.button) return;
+  /* Where the drag ends isn't held back for a frame */
+  drag.x = event->root_x;
+  drag.y = event->root_y;
+  update_drag();
+  end_drag();
+}
+static void handle_xcb_motion_notify(xcb_motion_notify_event_t *event) {
+  if (!drag.mode) return;
+  drag.x = event->root_x;
+  drag.y = event->root_y;
+  drag.pending = true;
+}
+static void handle_xcb_focus_in(xcb_focus_in_event_t *event) {
+  /* Focus following the pointer inside a client isn't a change of client */
+  if (event->detail == XCB_NOTIFY_DETAIL_POINTER) return;
+  client_t *client = client_find(event->event);
+  if (!client || focused == client) return;
+  mark_decoration(focused);
+  mark_decoration(client);
+  focused = client;
+  ewmh_outdated = true;
+  mark_bar();
+  if (client->mapped) client_focus_touch(&focus_order, client);
+  mark_snapshot();
+  publish_ipc_event(IPC_EVENT_FOCUS, client);
+}
+static void handle_xcb_focus_out(xcb_focus_out_event_t *event) {
+  if (event->detail == XCB_NOTIFY_DETAIL_POINTER) return;
+  client_t *client = client_find(event->event);
+  if (client && focused == client) {
+    focused = NULL;
+    ewmh_outdated = true;
+    mark_bar();
+    mark_decoration(client);
+  }
+}
+
+/* XKB handlers */
+static void handle_xkb_event(xkb_event_t *event) {
+  if (event->any.deviceID != xkb_device) return;
+  switch (event->any.xkbType) {
+    case XCB_XKB_NEW_KEYBOARD_NOTIFY:
+      if (event->new_keyboard_notify.changed & XCB_XKB_NKN_DETAIL_KEYCODES)
+        xkb_keymap_outdated = true;
+      break;
+    case XCB_XKB_MAP_NOTIFY:
+      xkb_keymap_outdated = true;
+      break;
+    case XCB_XKB_STATE_NOTIFY:
+      xkb_state_update_mask(
+          xkb_state,
+          event->state_notify.baseMods,
+          event->state_notify.latchedMods,
+          event->state_notify.lockedMods,
+          event->state_notify.baseGroup,
+          event->state_notify.latchedGroup,
+          event->state_notify.lockedGroup
+      );
+      break;
+  }
+}
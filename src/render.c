@@ -0,0 +1,303 @@
+/* Implements render.h */
+#include <render.h>
+
+/* Includes */
+#include <stdio.h>       /* For snprintf() */
+#include <stdlib.h>      /* For malloc(), free() */
+#include <string.h>      /* For memcpy(), strlen() */
+#include <time.h>        /* For clock_gettime() */
+#include <unistd.h>      /* For read(), write(), close() */
+#include <stdatomic.h>   /* For the rings' indices and the counters */
+#include <pthread.h>     /* For the worker thread */
+#include <semaphore.h>   /* For waking the worker thread */
+#include <sys/eventfd.h> /* For waking the event loop */
+
+/* Constants */
+_Static_assert(
+    (RENDER_QUEUE_SIZE & (RENDER_QUEUE_SIZE - 1)) == 0,
+    "RENDER_QUEUE_SIZE must be a power of two"
+);
+#define RENDER_GLYPH_WIDTH 5 /* Of the font's bitmaps, within their cell */
+#define RENDER_GLYPH_HEIGHT 7
+/*
+ * 5x7 font for printable ASCII, a byte per column, with the top row in the
+ * lowest bit
+ */
+static const uint8_t RENDER_FONT[95][RENDER_GLYPH_WIDTH] = {
+  { 0x00, 0x00, 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x5f, 0x00, 0x00 },
+  { 0x00, 0x07, 0x00, 0x07, 0x00 }, { 0x14, 0x7f, 0x14, 0x7f, 0x14 },
+  { 0x24, 0x2a, 0x7f, 0x2a, 0x12 }, { 0x23, 0x13, 0x08, 0x64, 0x62 },
+  { 0x36, 0x49, 0x55, 0x22, 0x50 }, { 0x00, 0x05, 0x03, 0x00, 0x00 },
+  { 0x00, 0x1c, 0x22, 0x41, 0x00 }, { 0x00, 0x41, 0x22, 0x1c, 0x00 },
+  { 0x08, 0x2a, 0x1c, 0x2a, 0x08 }, { 0x08, 0x08, 0x3e, 0x08, 0x08 },
+  { 0x00, 0x50, 0x30, 0x00, 0x00 }, { 0x08, 0x08, 0x08, 0x08, 0x08 },
+  { 0x00, 0x60, 0x60, 0x00, 0x00 }, { 0x20, 0x10, 0x08, 0x04, 0x02 },
+  { 0x3e, 0x51, 0x49, 0x45, 0x3e }, { 0x00, 0x42, 0x7f, 0x40, 0x00 },
+  { 0x42, 0x61, 0x51, 0x49, 0x46 }, { 0x21, 0x41, 0x45, 0x4b, 0x31 },
+  { 0x18, 0x14, 0x12, 0x7f, 0x10 }, { 0x27, 0x45, 0x45, 0x45, 0x39 },
+  { 0x3c, 0x4a, 0x49, 0x49, 0x30 }, { 0x01, 0x71, 0x09, 0x05, 0x03 },
+  { 0x36, 0x49, 0x49, 0x49, 0x36 }, { 0x06, 0x49, 0x49, 0x29, 0x1e },
+  { 0x00, 0x36, 0x36, 0x00, 0x00 }, { 0x00, 0x56, 0x36, 0x00, 0x00 },
+  { 0x08, 0x14, 0x22, 0x41, 0x00 }, { 0x14, 0x14, 0x14, 0x14, 0x14 },
+  { 0x00, 0x41, 0x22, 0x14, 0x08 }, { 0x02, 0x01, 0x51, 0x09, 0x06 },
+  { 0x32, 0x49, 0x79, 0x41, 0x3e }, { 0x7e, 0x11, 0x11, 0x11, 0x7e },
+  { 0x7f, 0x49, 0x49, 0x49, 0x36 }, { 0x3e, 0x41, 0x41, 0x41, 0x22 },
+  { 0x7f, 0x41, 0x41, 0x22, 0x1c }, { 0x7f, 0x49, 0x49, 0x49, 0x41 },
+  { 0x7f, 0x09, 0x09, 0x09, 0x01 }, { 0x3e, 0x41, 0x49, 0x49, 0x7a },
+  { 0x7f, 0x08, 0x08, 0x08, 0x7f }, { 0x00, 0x41, 0x7f, 0x41, 0x00 },
+  { 0x20, 0x40, 0x41, 0x3f, 0x01 }, { 0x7f, 0x08, 0x14, 0x22, 0x41 },
+  { 0x7f, 0x40, 0x40, 0x40, 0x40 }, { 0x7f, 0x02, 0x0c, 0x02, 0x7f },
+  { 0x7f, 0x04, 0x08, 0x10, 0x7f }, { 0x3e, 0x41, 0x41, 0x41, 0x3e },
+  { 0x7f, 0x09, 0x09, 0x09, 0x06 }, { 0x3e, 0x41, 0x51, 0x21, 0x5e },
+  { 0x7f, 0x09, 0x19, 0x29, 0x46 }, { 0x46, 0x49, 0x49, 0x49, 0x31 },
+  { 0x01, 0x01, 0x7f, 0x01, 0x01 }, { 0x3f, 0x40, 0x40, 0x40, 0x3f },
+  { 0x1f, 0x20, 0x40, 0x20, 0x1f }, { 0x3f, 0x40, 0x38, 0x40, 0x3f },
+  { 0x63, 0x14, 0x08, 0x14, 0x63 }, { 0x07, 0x08, 0x70, 0x08, 0x07 },
+  { 0x61, 0x51, 0x49, 0x45, 0x43 }, { 0x00, 0x7f, 0x41, 0x41, 0x00 },
+  { 0x02, 0x04, 0x08, 0x10, 0x20 }, { 0x00, 0x41, 0x41, 0x7f, 0x00 },
+  { 0x04, 0x02, 0x01, 0x02, 0x04 }, { 0x40, 0x40, 0x40, 0x40, 0x40 },
+  { 0x00, 0x01, 0x02, 0x04, 0x00 }, { 0x20, 0x54, 0x54, 0x54, 0x78 },
+  { 0x7f, 0x48, 0x44, 0x44, 0x38 }, { 0x38, 0x44, 0x44, 0x44, 0x20 },
+  { 0x38, 0x44, 0x44, 0x48, 0x7f }, { 0x38, 0x54, 0x54, 0x54, 0x18 },
+  { 0x08, 0x7e, 0x09, 0x01, 0x02 }, { 0x0c, 0x52, 0x52, 0x52, 0x3e },
+  { 0x7f, 0x08, 0x04, 0x04, 0x78 }, { 0x00, 0x44, 0x7d, 0x40, 0x00 },
+  { 0x20, 0x40, 0x44, 0x3d, 0x00 }, { 0x7f, 0x10, 0x28, 0x44, 0x00 },
+  { 0x00, 0x41, 0x7f, 0x40, 0x00 }, { 0x7c, 0x04, 0x18, 0x04, 0x78 },
+  { 0x7c, 0x08, 0x04, 0x04, 0x78 }, { 0x38, 0x44, 0x44, 0x44, 0x38 },
+  { 0x7c, 0x14, 0x14, 0x14, 0x08 }, { 0x08, 0x14, 0x14, 0x18, 0x7c },
+  { 0x7c, 0x08, 0x04, 0x04, 0x08 }, { 0x48, 0x54, 0x54, 0x54, 0x20 },
+  { 0x04, 0x3f, 0x44, 0x40, 0x20 }, { 0x3c, 0x40, 0x40, 0x20, 0x7c },
+  { 0x1c, 0x20, 0x40, 0x20, 0x1c }, { 0x3c, 0x40, 0x30, 0x40, 0x3c },
+  { 0x44, 0x28, 0x10, 0x28, 0x44 }, { 0x0c, 0x50, 0x50, 0x50, 0x3c },
+  { 0x44, 0x64, 0x54, 0x4c, 0x44 }, { 0x00, 0x08, 0x36, 0x41, 0x00 },
+  { 0x00, 0x00, 0x7f, 0x00, 0x00 }, { 0x00, 0x41, 0x36, 0x08, 0x00 },
+  { 0x08, 0x04, 0x08, 0x10, 0x08 },
+};
+
+/*
+ * Two rings, jobs from the event thread to the worker and images back. Every
+ * job comes back as exactly one image, so capping the jobs in flight at the
+ * ring size means the image ring can never fill up
+ */
+typedef struct {
+  render_job_t job;
+  uint64_t queued_ns;
+} render_entry_t;
+static render_entry_t render_jobs[RENDER_QUEUE_SIZE];
+static atomic_size_t render_job_head = 0;   /* Only written by the event thread */
+static atomic_size_t render_job_tail = 0;   /* Only written by the worker */
+static render_image_t render_images[RENDER_QUEUE_SIZE];
+static atomic_size_t render_image_head = 0; /* Only written by the worker */
+static atomic_size_t render_image_tail = 0; /* Only written by the event thread */
+static int render_fd = -1;
+#if RENDER_THREAD
+static atomic_bool render_running = false;
+static sem_t render_ready;
+static pthread_t render_thread;
+#endif
+/* Counters */
+static atomic_uint_fast64_t render_submitted = 0;
+static atomic_uint_fast64_t render_rejected = 0;
+static atomic_uint_fast64_t render_rendered = 0;
+static atomic_uint_fast64_t render_worst_ns = 0;
+
+/* Time */
+static uint64_t render_now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec*1000000000 + time.tv_nsec;
+}
+
+/* Text layout */
+static uint32_t render_glyphs(const char *text, uint8_t *glyphs) {
+  /* One glyph per character, with every UTF-8 sequence past ASCII as ? */
+  uint32_t count = 0;
+  for (const unsigned char *c = (const unsigned char *)text; *c; c++) {
+    if ((*c & 0xc0) == 0x80) continue;
+    uint8_t glyph = *c >= 0x20 && *c < 0x7f ? *c - 0x20 : '?' - 0x20;
+    if (glyphs) glyphs[count] = glyph;
+    count++;
+  }
+  return count;
+}
+uint32_t render_text_width(const char *text, uint16_t scale) {
+  uint32_t count = render_glyphs(text, NULL);
+  if (!scale) scale = 1;
+  /* The last glyph needs no gap after it */
+  return count ? (count*RENDER_FONT_WIDTH - 1)*scale : 0;
+}
+
+/* Rendering */
+static void render_draw(const render_entry_t *entry, render_image_t *image) {
+  const render_job_t *job = &entry->job;
+  *image = (render_image_t){
+    .drawable = job->drawable, .gc = job->gc, .x = job->x, .y = job->y,
+    .tag = job->tag, .width = job->width, .height = job->height
+  };
+  uint32_t width = job->width, height = job->height;
+  image->pixels = malloc(sizeof(uint32_t)*width*height);
+  if (!image->pixels) return;
+  for (uint32_t i = 0; i < width*height; i++)
+    image->pixels[i] = job->background;
+
+  /* Text that doesn't fit is cut short, ending in dots */
+  uint8_t glyphs[RENDER_TEXT_SIZE];
+  uint32_t count = render_glyphs(job->text, glyphs);
+  uint32_t scale = job->scale ? job->scale : 1;
+  uint32_t cell = RENDER_FONT_WIDTH*scale;
+  uint32_t room = width > 2u*job->padding ? width - 2u*job->padding : 0;
+  uint32_t fits = (room + scale)/cell;
+  if (count > fits) {
+    count = fits;
+    for (uint32_t i = count >= 3 ? count - 3 : 0; i < count; i++)
+      glyphs[i] = '.' - 0x20;
+  }
+  uint32_t text_width = count ? (count*RENDER_FONT_WIDTH - 1)*scale : 0;
+  int32_t x = job->padding;
+  if (job->align == RENDER_ALIGN_CENTER) x += (room - text_width)/2;
+  else if (job->align == RENDER_ALIGN_RIGHT) x += room - text_width;
+  int32_t y = ((int32_t)height - RENDER_GLYPH_HEIGHT*(int32_t)scale)/2;
+
+  for (uint32_t g = 0; g < count; g++, x += cell) {
+    const uint8_t *columns = RENDER_FONT[glyphs[g]];
+    for (uint32_t column = 0; column < RENDER_GLYPH_WIDTH; column++) {
+      for (uint32_t row = 0; row < RENDER_GLYPH_HEIGHT; row++) {
+        if (!(columns[column] >> row & 1)) continue;
+        for (uint32_t dy = 0; dy < scale; dy++) {
+          int32_t py = y + row*scale + dy;
+          if (py < 0 || py >= (int32_t)height) continue;
+          uint32_t *line = image->pixels + py*width;
+          for (uint32_t dx = 0; dx < scale; dx++) {
+            int32_t px = x + column*scale + dx;
+            if (px >= 0 && px < (int32_t)width) line[px] = job->foreground;
+          }
+        }
+      }
+    }
+  }
+}
+static void render_finish(const render_entry_t *entry, render_image_t *image) {
+  uint64_t ns = render_now() - entry->queued_ns;
+  image->queued_ns = ns;
+  if (ns > atomic_load_explicit(&render_worst_ns, memory_order_relaxed))
+    atomic_store_explicit(&render_worst_ns, ns, memory_order_relaxed);
+  atomic_fetch_add_explicit(&render_rendered, 1, memory_order_relaxed);
+  /* Published before the eventfd wakes anyone to look */
+  size_t head = atomic_load_explicit(&render_image_head, memory_order_relaxed);
+  atomic_store_explicit(&render_image_head, head + 1, memory_order_release);
+  uint64_t one = 1;
+  if (write(render_fd, &one, sizeof(one)) < 0) { }
+}
+#if RENDER_THREAD
+static void *render_worker(void *arg) {
+  while (atomic_load(&render_running)) {
+    if (sem_wait(&render_ready) < 0) continue;
+    size_t tail = atomic_load_explicit(&render_job_tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&render_job_head, memory_order_acquire);
+    for (; tail != head; tail++) {
+      const render_entry_t *entry = &render_jobs[tail & (RENDER_QUEUE_SIZE - 1)];
+      size_t image =
+        atomic_load_explicit(&render_image_head, memory_order_relaxed);
+      render_draw(entry, &render_images[image & (RENDER_QUEUE_SIZE - 1)]);
+      atomic_store_explicit(&render_job_tail, tail + 1, memory_order_release);
+      render_finish(entry, &render_images[image & (RENDER_QUEUE_SIZE - 1)]);
+    }
+  }
+  return NULL;
+}
+#endif
+
+/* Setup and cleanup */
+int render_init(void) {
+  render_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (render_fd < 0) return -1;
+#if RENDER_THREAD
+  if (sem_init(&render_ready, 0, 0) < 0) {
+    close(render_fd);
+    return render_fd = -1;
+  }
+  atomic_store(&render_running, true);
+  if (pthread_create(&render_thread, NULL, render_worker, NULL)) {
+    atomic_store(&render_running, false);
+    sem_destroy(&render_ready);
+    close(render_fd);
+    return render_fd = -1;
+  }
+#endif
+  return render_fd;
+}
+void render_cleanup(void) {
+  if (render_fd < 0) return;
+#if RENDER_THREAD
+  atomic_store(&render_running, false);
+  sem_post(&render_ready);
+  pthread_join(render_thread, NULL);
+  sem_destroy(&render_ready);
+#endif
+  render_image_t image;
+  while (render_collect(&image)) render_release(&image);
+  close(render_fd);
+  render_fd = -1;
+}
+
+/* Jobs */
+bool render_submit(const render_job_t *job) {
+  if (render_fd < 0 || job->width > RENDER_MAX_WIDTH
+      || job->height > RENDER_MAX_HEIGHT)
+    return false;
+  size_t head = atomic_load_explicit(&render_job_head, memory_order_relaxed);
+  size_t done = atomic_load_explicit(&render_image_tail, memory_order_relaxed);
+  if (head - done >= RENDER_QUEUE_SIZE) {
+    atomic_fetch_add_explicit(&render_rejected, 1, memory_order_relaxed);
+    return false;
+  }
+  render_entry_t *entry = &render_jobs[head & (RENDER_QUEUE_SIZE - 1)];
+  entry->job = *job;
+  entry->job.text[RENDER_TEXT_SIZE - 1] = '\0';
+  entry->queued_ns = render_now();
+  atomic_fetch_add_explicit(&render_submitted, 1, memory_order_relaxed);
+#if RENDER_THREAD
+  atomic_store_explicit(&render_job_head, head + 1, memory_order_release);
+  sem_post(&render_ready);
+#else
+  /* Rendered on the spot, but handed back the same way */
+  size_t image = atomic_load_explicit(&render_image_head, memory_order_relaxed);
+  render_draw(entry, &render_images[image & (RENDER_QUEUE_SIZE - 1)]);
+  atomic_store_explicit(&render_job_head, head + 1, memory_order_relaxed);
+  atomic_store_explicit(&render_job_tail, head + 1, memory_order_relaxed);
+  render_finish(entry, &render_images[image & (RENDER_QUEUE_SIZE - 1)]);
+#endif
+  return true;
+}
+bool render_collect(render_image_t *image) {
+  if (render_fd < 0) return false;
+  size_t tail = atomic_load_explicit(&render_image_tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&render_image_head, memory_order_acquire);
+  if (tail == head) {
+    /* Only cleared once empty, so a wakeup is never lost */
+    uint64_t count;
+    if (read(render_fd, &count, sizeof(count)) < 0) { }
+    head = atomic_load_explicit(&render_image_head, memory_order_acquire);
+    if (tail == head) return false;
+  }
+  *image = render_images[tail & (RENDER_QUEUE_SIZE - 1)];
+  atomic_store_explicit(&render_image_tail, tail + 1, memory_order_release);
+  return true;
+}
+void render_release(render_image_t *image) {
+  free(image->pixels);
+  image->pixels = NULL;
+}
+
+/* Counters */
+size_t render_format(char *buffer, size_t size) {
+  return snprintf(
+      buffer, size,
+      "%-12s submitted %llu rejected %llu rendered %llu worst %lluns\n",
+      "render",
+      (unsigned long long)atomic_load(&render_submitted),
+      (unsigned long long)atomic_load(&render_rejected),
+      (unsigned long long)atomic_load(&render_rendered),
+      (unsigned long long)atomic_load(&render_worst_ns)
+  );
+}
@@ -0,0 +1,220 @@
+/* Implements replay.h */
+#include <replay.h>
+
+/* Includes */
+#include <pthread.h>    /* For pthread_create(), pthread_join() */
+#include <stdatomic.h>  /* For atomic_uint_fast64_t */
+#include <stdbool.h>
+#include <string.h>     /* For memset(), memcpy(), strerror() */
+#include <unistd.h>     /* For read(), write(), close() */
+#include <errno.h>      /* For errno */
+#include <sys/socket.h> /* For socketpair() */
+#include <logging.h>
+
+/* Constants */
+#define REPLAY_VENDOR "pwm replay"
+#define REPLAY_ROOT 0x100
+#define REPLAY_VISUAL 0x21
+#define REPLAY_ATOM_BASE 0x1000 /* Past the predefined atoms */
+#define REPLAY_BUFFER_SIZE 65536
+
+/* State */
+static int replay_fd = -1;
+static uint16_t replay_width = 0;
+static uint16_t replay_height = 0;
+static pthread_t replay_thread;
+static atomic_uint_fast64_t replay_count = 0;
+
+/* Requests with replies that fit in 32 bytes, and the longer ones */
+static bool replay_has_reply(uint8_t opcode, uint32_t *extra) {
+  *extra = 0;
+  switch (opcode) {
+    case XCB_GET_WINDOW_ATTRIBUTES:
+      *extra = 12;
+      return true;
+    case XCB_GET_GEOMETRY:
+    case XCB_QUERY_TREE:
+    case XCB_INTERN_ATOM:
+    case XCB_GET_ATOM_NAME:
+    case XCB_GET_PROPERTY:
+    case XCB_LIST_PROPERTIES:
+    case XCB_GET_SELECTION_OWNER:
+    case XCB_GRAB_POINTER:
+    case XCB_GRAB_KEYBOARD:
+    case XCB_QUERY_POINTER:
+    case XCB_GET_MOTION_EVENTS:
+    case XCB_TRANSLATE_COORDINATES:
+    case XCB_GET_INPUT_FOCUS:
+    case XCB_QUERY_KEYMAP:
+    case XCB_QUERY_FONT:
+    case XCB_LIST_FONTS:
+    case XCB_GET_IMAGE:
+    case XCB_ALLOC_COLOR:
+    case XCB_QUERY_COLORS:
+    case XCB_QUERY_EXTENSION:
+    case XCB_LIST_EXTENSIONS:
+    case XCB_GET_KEYBOARD_MAPPING:
+    case XCB_GET_KEYBOARD_CONTROL:
+    case XCB_GET_POINTER_CONTROL:
+    case XCB_GET_SCREEN_SAVER:
+    case XCB_LIST_HOSTS:
+    case XCB_GET_POINTER_MAPPING:
+    case XCB_GET_MODIFIER_MAPPING:
+      return true;
+    default:
+      return false;
+  }
+}
+static bool replay_write(int fd, const void *data, size_t length) {
+  const char *bytes = data;
+  while (length) {
+    ssize_t result = write(fd, bytes, length);
+    if (result < 0 && errno == EINTR) continue;
+    if (result <= 0) return false;
+    bytes += result;
+    length -= result;
+  }
+  return true;
+}
+static bool replay_read(int fd, void *data, size_t length) {
+  char *bytes = data;
+  while (length) {
+    ssize_t result = read(fd, bytes, length);
+    if (result < 0 && errno == EINTR) continue;
+    if (result <= 0) return false;
+    bytes += result;
+    length -= result;
+  }
+  return true;
+}
+
+/* Connection setup */
+static bool replay_handshake(int fd, uint16_t width, uint16_t height) {
+  /* Byte order, protocol version and authorization, which is ignored */
+  uint8_t request[12];
+  if (!replay_read(fd, request, sizeof(request))) return false;
+  uint16_t name_length, data_length;
+  memcpy(&name_length, request + 6, 2);
+  memcpy(&data_length, request + 8, 2);
+  char auth[REPLAY_BUFFER_SIZE];
+  size_t auth_length = ((name_length + 3) & ~3) + ((data_length + 3) & ~3);
+  if (auth_length > sizeof(auth) || !replay_read(fd, auth, auth_length))
+    return false;
+
+  /* One screen with one 24 bit TrueColor visual */
+  struct {
+    xcb_setup_t setup;
+    char vendor[(sizeof(REPLAY_VENDOR) - 1 + 3) & ~3];
+    xcb_format_t format;
+    xcb_screen_t screen;
+    xcb_depth_t depth;
+    xcb_visualtype_t visual;
+  } reply;
+  memset(&reply, 0, sizeof(reply));
+  reply.setup = (xcb_setup_t){
+    .status = 1,
+    .protocol_major_version = 11,
+    .length = (sizeof(reply) - 8)/4,
+    .resource_id_base = 0x00200000,
+    .resource_id_mask = 0x001fffff,
+    .vendor_len = sizeof(REPLAY_VENDOR) - 1,
+    .maximum_request_length = 0xffff,
+    .roots_len = 1,
+    .pixmap_formats_len = 1,
+    .bitmap_format_scanline_unit = 32,
+    .bitmap_format_scanline_pad = 32,
+    .min_keycode = 8,
+    .max_keycode = 255
+  };
+  memcpy(reply.vendor, REPLAY_VENDOR, sizeof(REPLAY_VENDOR) - 1);
+  reply.format = (xcb_format_t){ 24, 32, 32, { 0 } };
+  reply.screen = (xcb_screen_t){
+    .root = REPLAY_ROOT,
+    .white_pixel = 0xffffff,
+    .width_in_pixels = width,
+    .height_in_pixels = height,
+    .width_in_millimeters = width/4,
+    .height_in_millimeters = height/4,
+    .min_installed_maps = 1,
+    .max_installed_maps = 1,
+    .root_visual = REPLAY_VISUAL,
+    .root_depth = 24,
+    .allowed_depths_len = 1
+  };
+  reply.depth = (xcb_depth_t){ .depth = 24, .visuals_len = 1 };
+  reply.visual = (xcb_visualtype_t){
+    .visual_id = REPLAY_VISUAL,
+    ._class = XCB_VISUAL_CLASS_TRUE_COLOR,
+    .bits_per_rgb_value = 8,
+    .colormap_entries = 256,
+    .red_mask = 0xff0000,
+    .green_mask = 0xff00,
+    .blue_mask = 0xff
+  };
+  return replay_write(fd, &reply, sizeof(reply));
+}
+
+/* Request sink */
+static void *replay_server(void *arg) {
+  int fd = replay_fd;
+  static char buffer[REPLAY_BUFFER_SIZE];
+  uint16_t sequence = 0;
+  if (!replay_handshake(fd, replay_width, replay_height)) goto done;
+  for (;;) {
+    /* Opcode, a byte of data and the length in 4 byte units, header included */
+    uint8_t header[4];
+    if (!replay_read(fd, header, sizeof(header))) break;
+    uint16_t length;
+    memcpy(&length, header + 2, 2);
+    /* No BIG-REQUESTS, so a length of 0 can't happen */
+    if (!length) break;
+    for (uint32_t left = length*4 - 4; left;) {
+      uint32_t chunk = left < sizeof(buffer) ? left : sizeof(buffer);
+      if (!replay_read(fd, buffer, chunk)) goto done;
+      left -= chunk;
+    }
+    sequence++;
+    atomic_fetch_add_explicit(&replay_count, 1, memory_order_relaxed);
+
+    uint32_t extra;
+    if (!replay_has_reply(header[0], &extra)) continue;
+    uint8_t reply[32 + 12] = { 1 };
+    uint32_t extra_words = extra/4;
+    memcpy(reply + 2, &sequence, 2);
+    memcpy(reply + 4, &extra_words, 4);
+    if (header[0] == XCB_INTERN_ATOM) {
+      uint32_t atom = REPLAY_ATOM_BASE + sequence;
+      memcpy(reply + 8, &atom, 4);
+    } else if (header[0] == XCB_GET_INPUT_FOCUS) {
+      uint32_t focus = REPLAY_ROOT;
+      memcpy(reply + 8, &focus, 4);
+    }
+    if (!replay_write(fd, reply, 32 + extra)) break;
+  }
+done:
+  close(fd);
+  return NULL;
+}
+
+/* Connecting */
+xcb_connection_t *replay_connect(uint16_t width, uint16_t height) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+    LOG_ERROR("Failed to create replay socket (%s)", strerror(errno));
+  replay_fd = fds[1];
+  replay_width = width;
+  replay_height = height;
+  /* The handshake happens on the server thread while XCB waits for it */
+  if (pthread_create(&replay_thread, NULL, replay_server, NULL))
+    LOG_ERROR("Failed to start replay server");
+  xcb_connection_t *connection = xcb_connect_to_fd(fds[0], NULL);
+  if (xcb_connection_has_error(connection))
+    LOG_ERROR("Failed to connect to replay server");
+  return connection;
+}
+uint64_t replay_requests(void) {
+  return atomic_load_explicit(&replay_count, memory_order_relaxed);
+}
+void replay_cleanup(void) {
+  pthread_join(replay_thread, NULL);
+}
@@ -0,0 +1,324 @@
+/* Implements rules.h */
+#include <rules.h>
+
+/* Includes */
+#include <stdlib.h> /* For malloc(), calloc(), free() */
+#include <string.h> /* For strlen(), strcmp(), strpbrk(), memcpy() */
+
+/* Constants */
+#define RULES_MIN_CAPACITY 8 /* Of an exact table, power of two */
+
+/*
+ * Exact strings of one field, by open addressing with linear probing. Rules
+ * with the same string share its entry, and each entry has a bit vector of
+ * the rules it satisfies
+ */
+typedef struct {
+  const char *string; /* NULL for an empty slot */
+  uint32_t hash;
+  uint32_t set;       /* Offset of its vector in exact_sets */
+} rules_exact_t;
+
+/*
+ * Globs of one field, as one automaton. Each glob has a start state and a
+ * state per character that isn't *, all numbered back to back, and the set of
+ * states the string so far could have reached is kept as a bit vector. A
+ * character moves every state to the next one if that one accepts it, and
+ * states followed by a * also stay put. Start states accept nothing, so
+ * moving past the end of one glob never reaches the next
+ */
+typedef struct {
+  uint64_t *any;        /* Rules with no pattern for the field */
+  rules_exact_t *exact;
+  uint32_t exact_capacity; /* 0 without any exact strings */
+  uint64_t *exact_sets;
+  uint32_t num_exact;
+  uint32_t num_states;
+  uint32_t state_words;
+  uint64_t *start;
+  uint64_t *loop;
+  uint64_t *accept;     /* Per byte, the states it can move into */
+  uint32_t num_globs;
+  uint32_t *glob_final; /* Accepting state of each glob */
+  uint32_t *glob_rule;
+} rules_field_t;
+
+struct rules {
+  rule_t *rules;
+  uint32_t num_rules;
+  uint32_t rule_words;
+  char *strings; /* Every pattern, copied */
+  rules_field_t fields[RULE_FIELDS];
+  uint64_t *scratch; /* Rules matched so far, and for the current field */
+  uint64_t *states;  /* Of the automaton being run */
+};
+
+/* Bit vectors */
+static uint32_t rules_words(uint32_t bits) {
+  return (bits + 63)/64;
+}
+static void rules_set_bit(uint64_t *vector, uint32_t bit) {
+  vector[bit/64] |= 1ull << (bit % 64);
+}
+static bool rules_get_bit(const uint64_t *vector, uint32_t bit) {
+  return vector[bit/64] >> (bit % 64) & 1;
+}
+
+/* Exact strings */
+static uint32_t rules_hash(const char *string) {
+  /* FNV-1a */
+  uint32_t hash = 2166136261u;
+  for (const unsigned char *c = (const unsigned char *)string; *c; c++)
+    hash = (hash ^ *c)*16777619u;
+  return hash;
+}
+static rules_exact_t *rules_find_exact(
+    const rules_field_t *field, const char *string, uint32_t hash
+) {
+  /* The slot with the string, or the empty one it would go in */
+  uint32_t mask = field->exact_capacity - 1;
+  uint32_t slot = hash & mask;
+  while (field->exact[slot].string
+      && (field->exact[slot].hash != hash
+        || strcmp(field->exact[slot].string, string)))
+    slot = (slot + 1) & mask;
+  return &field->exact[slot];
+}
+
+/* Globs */
+static bool rules_is_glob(const char *pattern) {
+  return strpbrk(pattern, "*?") != NULL;
+}
+static uint32_t rules_glob_states(const char *pattern) {
+  uint32_t states = 1;
+  for (const char *c = pattern; *c; c++) states += *c != '*';
+  return states;
+}
+static void rules_add_glob(
+    rules_field_t *field, const char *pattern, uint32_t rule
+) {
+  uint32_t words = field->state_words;
+  uint32_t state = field->num_states;
+  rules_set_bit(field->start, state);
+  for (const char *c = pattern; *c; c++) {
+    if (*c == '*') {
+      rules_set_bit(field->loop, state);
+      continue;
+    }
+    state++;
+    if (*c == '?') {
+      for (uint32_t byte = 1; byte < 256; byte++)
+        rules_set_bit(field->accept + byte*words, state);
+    } else {
+      rules_set_bit(field->accept + (unsigned char)*c*words, state);
+    }
+  }
+  field->glob_final[field->num_globs] = state;
+  field->glob_rule[field->num_globs] = rule;
+  field->num_globs++;
+  field->num_states = state + 1;
+}
+static void rules_run_globs(
+    const rules_field_t *field, const char *string, uint64_t *states,
+    uint64_t *matched
+) {
+  uint32_t words = field->state_words;
+  memcpy(states, field->start, sizeof(uint64_t)*words);
+  for (const unsigned char *c = (const unsigned char *)string; *c; c++) {
+    const uint64_t *accept = field->accept + (size_t)*c*words;
+    uint64_t carry = 0;
+    uint64_t alive = 0;
+    for (uint32_t w = 0; w < words; w++) {
+      uint64_t moved = states[w] << 1 | carry;
+      carry = states[w] >> 63;
+      states[w] = (moved & accept[w]) | (states[w] & field->loop[w]);
+      alive |= states[w];
+    }
+    /* No glob can match once every state is dead */
+    if (!alive) return;
+  }
+  for (uint32_t g = 0; g < field->num_globs; g++)
+    if (rules_get_bit(states, field->glob_final[g]))
+      rules_set_bit(matched, field->glob_rule[g]);
+}
+
+/* Compiling */
+static bool rules_compile_field(rules_t *compiled, rule_field_t f) {
+  rules_field_t *field = &compiled->fields[f];
+  uint32_t num_exact = 0;
+  uint32_t num_globs = 0;
+  uint32_t num_states = 0;
+  for (uint32_t r = 0; r < compiled->num_rules; r++) {
+    const char *pattern = compiled->rules[r].patterns[f];
+    if (!pattern) continue;
+    if (rules_is_glob(pattern)) {
+      num_globs++;
+      num_states += rules_glob_states(pattern);
+    } else {
+      num_exact++;
+    }
+  }
+
+  /* Sized up front, nothing grows afterwards */
+  uint32_t rule_words = compiled->rule_words;
+  field->any = calloc(rule_words, sizeof(uint64_t));
+  if (!field->any) return false;
+  if (num_exact) {
+    field->exact_capacity = RULES_MIN_CAPACITY;
+    while (field->exact_capacity < num_exact*2) field->exact_capacity *= 2;
+    field->exact = calloc(field->exact_capacity, sizeof(rules_exact_t));
+    field->exact_sets =
+      calloc((size_t)num_exact*rule_words, sizeof(uint64_t));
+    if (!field->exact || !field->exact_sets) return false;
+  }
+  if (num_globs) {
+    uint32_t words = rules_words(num_states);
+    field->state_words = words;
+    field->start = calloc(words, sizeof(uint64_t));
+    field->loop = calloc(words, sizeof(uint64_t));
+    field->accept = calloc((size_t)256*words, sizeof(uint64_t));
+    field->glob_final = malloc(sizeof(uint32_t)*num_globs);
+    field->glob_rule = malloc(sizeof(uint32_t)*num_globs);
+    if (!field->start || !field->loop || !field->accept
+        || !field->glob_final || !field->glob_rule)
+      return false;
+  }
+
+  for (uint32_t r = 0; r < compiled->num_rules; r++) {
+    const char *pattern = compiled->rules[r].patterns[f];
+    if (!pattern) {
+      rules_set_bit(field->any, r);
+    } else if (rules_is_glob(pattern)) {
+      rules_add_glob(field, pattern, r);
+    } else {
+      uint32_t hash = rules_hash(pattern);
+      rules_exact_t *entry = rules_find_exact(field, pattern, hash);
+      if (!entry->string) {
+        entry->string = pattern;
+        entry->hash = hash;
+        entry->set = field->num_exact++*rule_words;
+      }
+      rules_set_bit(field->exact_sets + entry->set, r);
+    }
+  }
+  return true;
+}
+rules_t *rules_compile(const rule_t *rules, uint32_t num_rules) {
+  rules_t *compiled = calloc(1, sizeof(rules_t));
+  if (!compiled) return NULL;
+  compiled->num_rules = num_rules;
+  compiled->rule_words = rules_words(num_rules ? num_rules : 1);
+
+  /* Patterns are copied into one block, so the caller's can go away */
+  size_t strings_size = 1;
+  for (uint32_t r = 0; r < num_rules; r++)
+    for (uint32_t f = 0; f < RULE_FIELDS; f++)
+      if (rules[r].patterns[f])
+        strings_size += strlen(rules[r].patterns[f]) + 1;
+  compiled->rules = malloc(sizeof(rule_t)*(num_rules ? num_rules : 1));
+  compiled->strings = malloc(strings_size);
+  if (!compiled->rules || !compiled->strings) {
+    rules_free(compiled);
+    return NULL;
+  }
+  char *next = compiled->strings;
+  for (uint32_t r = 0; r < num_rules; r++) {
+    compiled->rules[r] = rules[r];
+    for (uint32_t f = 0; f < RULE_FIELDS; f++) {
+      if (!rules[r].patterns[f]) continue;
+      size_t size = strlen(rules[r].patterns[f]) + 1;
+      memcpy(next, rules[r].patterns[f], size);
+      compiled->rules[r].patterns[f] = next;
+      next += size;
+    }
+  }
+
+  uint32_t max_state_words = 1;
+  for (uint32_t f = 0; f < RULE_FIELDS; f++) {
+    if (!rules_compile_field(compiled, f)) {
+      rules_free(compiled);
+      return NULL;
+    }
+    if (compiled->fields[f].state_words > max_state_words)
+      max_state_words = compiled->fields[f].state_words;
+  }
+  compiled->scratch = malloc(sizeof(uint64_t)*compiled->rule_words*2);
+  compiled->states = malloc(sizeof(uint64_t)*max_state_words);
+  if (!compiled->scratch || !compiled->states) {
+    rules_free(compiled);
+    return NULL;
+  }
+  return compiled;
+}
+
+/* Matching */
+bool rules_match(
+    const rules_t *rules, const char *const strings[RULE_FIELDS],
+    rule_t *result
+) {
+  *result = (rule_t){ .floating = -1 };
+  uint32_t words = rules->rule_words;
+  uint64_t *matched = rules->scratch;
+  uint64_t *field_matched = rules->scratch + words;
+  for (uint32_t w = 0; w < words; w++) matched[w] = ~0ull;
+
+  /* A rule matches if every one of its fields does */
+  for (uint32_t f = 0; f < RULE_FIELDS; f++) {
+    const rules_field_t *field = &rules->fields[f];
+    const char *string = strings[f] ? strings[f] : "";
+    memcpy(field_matched, field->any, sizeof(uint64_t)*words);
+    if (field->exact_capacity) {
+      const rules_exact_t *entry =
+        rules_find_exact(field, string, rules_hash(string));
+      if (entry->string)
+        for (uint32_t w = 0; w < words; w++)
+          field_matched[w] |= field->exact_sets[entry->set + w];
+    }
+    if (field->num_globs)
+      rules_run_globs(field, string, rules->states, field_matched);
+    uint64_t any = 0;
+    for (uint32_t w = 0; w < words; w++) {
+      matched[w] &= field_matched[w];
+      any |= matched[w];
+    }
+    if (!any) return false;
+  }
+
+  bool found = false;
+  for (uint32_t w = 0; w < words; w++) {
+    for (uint64_t bits = matched[w]; bits; bits &= bits - 1) {
+      uint32_t r = w*64 + __builtin_ctzll(bits);
+      if (r >= rules->num_rules) break;
+      const rule_t *rule = &rules->rules[r];
+      if (rule->floating >= 0) result->floating = rule->floating;
+      if (rule->workspace) result->workspace = rule->workspace;
+      if (rule->output) result->output = rule->output;
+      found = true;
+    }
+  }
+  return found;
+}
+uint32_t rules_count(const rules_t *rules) {
+  return rules ? rules->num_rules : 0;
+}
+
+/* Cleanup */
+void rules_free(rules_t *rules) {
+  if (!rules) return;
+  for (uint32_t f = 0; f < RULE_FIELDS; f++) {
+    rules_field_t *field = &rules->fields[f];
+    free(field->any);
+    free(field->exact);
+    free(field->exact_sets);
+    free(field->start);
+    free(field->loop);
+    free(field->accept);
+    free(field->glob_final);
+    free(field->glob_rule);
+  }
+  free(rules->rules);
+  free(rules->strings);
+  free(rules->scratch);
+  free(rules->states);
+  free(rules);
+}
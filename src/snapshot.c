@@ -0,0 +1,175 @@
+/* Implements snapshot.h */
+#include <snapshot.h>
+
+/* Includes */
+#include <errno.h>     /* For errno */
+#include <fcntl.h>     /* For open() */
+#include <stdio.h>     /* For snprintf() */
+#include <stdlib.h>    /* For getenv() */
+#include <string.h>    /* For memcpy(), memcmp(), strerror() */
+#include <unistd.h>    /* For close(), ftruncate(), getuid() */
+#include <stdatomic.h> /* For atomic_thread_fence() */
+#include <sys/mman.h>  /* For mmap(), munmap() */
+#include <sys/stat.h>  /* For fstat(), S_ISREG() */
+#include <logging.h>
+
+/* Constants */
+#define SNAPSHOT_MIN_CLIENTS 64 /* Records the file starts with */
+
+/* State */
+static int snapshot_fd = -1; /* Kept open to grow the file */
+static snapshot_header_t *snapshot_header = NULL;
+static size_t snapshot_size = 0;
+
+/* Layout */
+static size_t snapshot_file_size(uint64_t capacity) {
+  return sizeof(snapshot_header_t)
+    + sizeof(snapshot_output_t)*SNAPSHOT_OUTPUTS
+    + sizeof(snapshot_client_t)*capacity;
+}
+static snapshot_output_t *snapshot_outputs(const snapshot_header_t *header) {
+  return (snapshot_output_t *)(header + 1);
+}
+static snapshot_client_t *snapshot_clients(const snapshot_header_t *header) {
+  return (snapshot_client_t *)(snapshot_outputs(header) + SNAPSHOT_OUTPUTS);
+}
+static bool snapshot_map(uint32_t capacity) {
+  /* Grown files are zero-filled, so new records start out free */
+  size_t size = snapshot_file_size(capacity);
+  if (ftruncate(snapshot_fd, size) < 0) return false;
+  void *map =
+    mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, snapshot_fd, 0);
+  if (map == MAP_FAILED) return false;
+  if (snapshot_header) munmap(snapshot_header, snapshot_size);
+  snapshot_header = map;
+  snapshot_size = size;
+  snapshot_header->capacity = capacity;
+  return true;
+}
+
+/*
+ * Without XDG_RUNTIME_DIR the path is in /tmp, where anyone could have left
+ * a link or a file to be written through or loaded
+ */
+static bool snapshot_owned(int fd) {
+  struct stat info;
+  return fstat(fd, &info) == 0 && S_ISREG(info.st_mode)
+    && info.st_uid == getuid();
+}
+
+/* Default path */
+void snapshot_path(char *path, size_t size) {
+  const char *snapshot = getenv("PWM_SNAPSHOT");
+  if (snapshot) {
+    snprintf(path, size, "%s", snapshot);
+    return;
+  }
+  const char *display = getenv("DISPLAY");
+  const char *runtime = getenv("XDG_RUNTIME_DIR");
+  char name[64];
+  snprintf(name, sizeof(name), "%s", display ? display : ":0");
+  for (char *c = name; *c; c++) if (*c == '/') *c = '_';
+  if (runtime)
+    snprintf(path, size, "%s/pwm-%s.state", runtime, name);
+  else
+    snprintf(path, size, "/tmp/pwm-%d-%s.state", (int)getuid(), name);
+}
+
+/* Writing */
+bool snapshot_open(const char *path, uint32_t root, uint64_t token) {
+  /* Truncated only once it's known to be this user's own file */
+  snapshot_fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+  if (snapshot_fd < 0) {
+    LOG_WARNING("Failed to open snapshot %s (%s)", path, strerror(errno));
+    return false;
+  }
+  if (!snapshot_owned(snapshot_fd)) {
+    LOG_WARNING("Not using snapshot %s, it isn't a file of this user's", path);
+    close(snapshot_fd);
+    snapshot_fd = -1;
+    return false;
+  }
+  if (ftruncate(snapshot_fd, 0) < 0 || !snapshot_map(SNAPSHOT_MIN_CLIENTS)) {
+    LOG_WARNING("Failed to map snapshot %s (%s)", path, strerror(errno));
+    close(snapshot_fd);
+    snapshot_fd = -1;
+    return false;
+  }
+  /* Incomplete until the first update ends */
+  memcpy(
+      snapshot_header->magic, SNAPSHOT_MAGIC, sizeof(snapshot_header->magic)
+  );
+  snapshot_header->version = SNAPSHOT_VERSION;
+  snapshot_header->sequence = 1;
+  snapshot_header->root = root;
+  snapshot_header->token = token;
+  LOG_INFO("Keeping a snapshot in %s", path);
+  return true;
+}
+bool snapshot_writing(void) {
+  return snapshot_header;
+}
+snapshot_header_t *snapshot_begin(void) {
+  snapshot_header->sequence |= 1;
+  return snapshot_header;
+}
+snapshot_output_t *snapshot_output(uint32_t index) {
+  return index < SNAPSHOT_OUTPUTS ? &snapshot_outputs(snapshot_header)[index]
+    : NULL;
+}
+snapshot_client_t *snapshot_client(uint32_t id) {
+  uint32_t capacity = snapshot_header->capacity;
+  if (id >= capacity) {
+    while (capacity <= id) capacity *= 2;
+    if (!snapshot_map(capacity)) {
+      LOG_WARNING("Failed to grow snapshot (%s)", strerror(errno));
+      return NULL;
+    }
+  }
+  return &snapshot_clients(snapshot_header)[id];
+}
+void snapshot_end(void) {
+  /* Every record is in place by the time the number goes even */
+  atomic_thread_fence(memory_order_release);
+  snapshot_header->sequence++;
+}
+void snapshot_close(void) {
+  if (!snapshot_header) return;
+  munmap(snapshot_header, snapshot_size);
+  close(snapshot_fd);
+  snapshot_header = NULL;
+  snapshot_fd = -1;
+}
+
+/* Reading */
+bool snapshot_load(const char *path, uint32_t root, snapshot_t *snapshot) {
+  int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat info;
+  void *map = MAP_FAILED;
+  if (snapshot_owned(fd) && fstat(fd, &info) == 0
+      && (size_t)info.st_size >= snapshot_file_size(0))
+    map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return false;
+  const snapshot_header_t *header = map;
+  if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic))
+      || header->version != SNAPSHOT_VERSION
+      || header->sequence & 1
+      || header->root != root
+      || header->num_outputs > SNAPSHOT_OUTPUTS
+      || snapshot_file_size(header->capacity) > (size_t)info.st_size) {
+    munmap(map, info.st_size);
+    return false;
+  }
+  snapshot->header = header;
+  snapshot->outputs = snapshot_outputs(header);
+  snapshot->clients = snapshot_clients(header);
+  snapshot->size = info.st_size;
+  return true;
+}
+void snapshot_unload(snapshot_t *snapshot) {
+  if (!snapshot->header) return;
+  munmap((void *)snapshot->header, snapshot->size);
+  snapshot->header = NULL;
+}
@@ -0,0 +1,105 @@
+/* Implements stats.h */
+#include <stats.h>
+
+/* Includes */
+#include <stdio.h> /* For snprintf() */
+#include <time.h>  /* For clock_gettime() */
+
+/*
+ * Buckets split each power of two of nanoseconds into STATS_SUB_BUCKETS, so a
+ * percentile read off a bucket's upper bound is at most 25% high
+ */
+#define STATS_SUB_BITS 2
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BITS)
+#define STATS_BUCKETS (64*STATS_SUB_BUCKETS)
+
+/* State */
+typedef struct {
+  uint64_t count;
+  uint64_t round_trips;
+  uint64_t max;
+  uint32_t buckets[STATS_BUCKETS];
+} stats_type_t;
+uint64_t stats_round_trips = 0;
+#if STATS
+static stats_type_t stats[STATS_TYPES + 1];
+#endif
+
+/* Buckets */
+static uint32_t stats_bucket(uint64_t ns) {
+  if (ns < STATS_SUB_BUCKETS) return ns;
+  uint32_t msb = 63 - __builtin_clzll(ns);
+  uint32_t sub = (ns >> (msb - STATS_SUB_BITS)) & (STATS_SUB_BUCKETS - 1);
+  return (msb - STATS_SUB_BITS + 1)*STATS_SUB_BUCKETS + sub;
+}
+static uint64_t stats_bucket_limit(uint32_t bucket) {
+  if (bucket < STATS_SUB_BUCKETS) return bucket;
+  uint32_t msb = bucket/STATS_SUB_BUCKETS + STATS_SUB_BITS - 1;
+  uint64_t sub = bucket % STATS_SUB_BUCKETS;
+  return ((STATS_SUB_BUCKETS + sub + 1) << (msb - STATS_SUB_BITS)) - 1;
+}
+static uint64_t stats_percentile(const stats_type_t *type, uint32_t percent) {
+  uint64_t rank = (type->count*percent + 99)/100;
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < STATS_BUCKETS; i++) {
+    seen += type->buckets[i];
+    if (seen >= rank)
+      return stats_bucket_limit(i) < type->max
+        ? stats_bucket_limit(i) : type->max;
+  }
+  return type->max;
+}
+
+/* Recording */
+stats_mark_t stats_begin(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (stats_mark_t){
+    (uint64_t)now.tv_sec*1000000000 + now.tv_nsec, stats_round_trips
+  };
+}
+void stats_end(uint32_t type, stats_mark_t mark) {
+#if STATS
+  uint64_t ns = stats_begin().time - mark.time;
+  stats_type_t *entry = &stats[type];
+  entry->count++;
+  entry->round_trips += stats_round_trips - mark.round_trips;
+  if (ns > entry->max) entry->max = ns;
+  entry->buckets[stats_bucket(ns)]++;
+#endif
+}
+
+/* Reporting */
+size_t stats_format(
+    char *buffer, size_t size, const char *(*name)(uint32_t type)
+) {
+#if STATS
+  size_t length = snprintf(
+      buffer, size, "%-20s %10s %10s %10s %10s %12s\n",
+      "type", "count", "p50 ns", "p99 ns", "max ns", "round trips"
+  );
+  for (uint32_t i = 0; i <= STATS_TYPES; i++) {
+    const stats_type_t *type = &stats[i];
+    if (!type->count) continue;
+    char number[16];
+    const char *type_name = i == STATS_LOOP ? "loop" : name(i);
+    if (!type_name) {
+      snprintf(number, sizeof(number), "%u", i);
+      type_name = number;
+    }
+    length += snprintf(
+        buffer + (length < size ? length : size),
+        length < size ? size - length : 0,
+        "%-20s %10llu %10llu %10llu %10llu %12llu\n",
+        type_name, (unsigned long long)type->count,
+        (unsigned long long)stats_percentile(type, 50),
+        (unsigned long long)stats_percentile(type, 99),
+        (unsigned long long)type->max,
+        (unsigned long long)type->round_trips
+    );
+  }
+  return length;
+#else
+  return snprintf(buffer, size, "Built without STATS\n");
+#endif
+}
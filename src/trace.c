@@ -0,0 +1,108 @@
+/* Implements trace.h */
+#include <trace.h>
+
+/* Includes */
+#include <errno.h>    /* For errno */
+#include <fcntl.h>    /* For open() */
+#include <string.h>   /* For memcpy(), memcmp(), strerror() */
+#include <time.h>     /* For clock_gettime() */
+#include <unistd.h>   /* For close(), ftruncate() */
+#include <sys/mman.h> /* For mmap(), munmap() */
+#include <sys/stat.h> /* For fstat() */
+#include <logging.h>
+
+/* State */
+static trace_header_t *trace_header = NULL;
+static trace_record_t *trace_records = NULL;
+static size_t trace_size = 0;
+static uint32_t trace_batch = 0;
+
+/* Recording */
+bool trace_open(const char *path, uint32_t capacity) {
+  if (!capacity || capacity & (capacity - 1)) {
+    LOG_WARNING("Trace capacity %u isn't a power of two", capacity);
+    return false;
+  }
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    LOG_WARNING("Failed to open trace %s (%s)", path, strerror(errno));
+    return false;
+  }
+  size_t size = sizeof(trace_header_t) + sizeof(trace_record_t)*capacity;
+  void *map = MAP_FAILED;
+  if (ftruncate(fd, size) == 0)
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  /* The mapping keeps the file open */
+  close(fd);
+  if (map == MAP_FAILED) {
+    LOG_WARNING("Failed to map trace %s (%s)", path, strerror(errno));
+    return false;
+  }
+  trace_header = map;
+  trace_records = (trace_record_t *)(trace_header + 1);
+  trace_size = size;
+  memcpy(trace_header->magic, TRACE_MAGIC, sizeof(trace_header->magic));
+  trace_header->version = TRACE_VERSION;
+  trace_header->capacity = capacity;
+  trace_header->written = 0;
+  LOG_INFO("Tracing events to %s", path);
+  return true;
+}
+void trace_record(xcb_generic_event_t *const *events, uint32_t num_events) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t time = (uint64_t)now.tv_sec*1000000000 + now.tv_nsec;
+  uint32_t mask = trace_header->capacity - 1;
+  for (uint32_t i = 0; i < num_events; i++) {
+    trace_record_t *record = &trace_records[trace_header->written++ & mask];
+    record->time = time;
+    record->batch = trace_batch;
+    record->pad = 0;
+    memcpy(record->event, events[i], sizeof(record->event));
+  }
+  trace_batch++;
+}
+void trace_close(void) {
+  if (!trace_header) return;
+  munmap(trace_header, trace_size);
+  trace_header = NULL;
+  trace_records = NULL;
+}
+bool trace_recording(void) {
+  return trace_header;
+}
+
+/* Reading */
+bool trace_load(const char *path, trace_t *trace) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat info;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(trace_header_t))
+    map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return false;
+  const trace_header_t *header = map;
+  uint64_t capacity = header->capacity;
+  if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic))
+      || header->version != TRACE_VERSION
+      || !capacity || capacity & (capacity - 1)
+      || sizeof(trace_header_t) + sizeof(trace_record_t)*capacity
+        > (size_t)info.st_size) {
+    munmap(map, info.st_size);
+    return false;
+  }
+  trace->header = header;
+  trace->records = (const trace_record_t *)(header + 1);
+  trace->count = header->written < capacity ? header->written : capacity;
+  trace->first = header->written - trace->count;
+  trace->size = info.st_size;
+  return true;
+}
+const trace_record_t *trace_get(const trace_t *trace, uint64_t i) {
+  return &trace->records[(trace->first + i) & (trace->header->capacity - 1)];
+}
+void trace_unload(trace_t *trace) {
+  munmap((void *)trace->header, trace->size);
+  trace->header = NULL;
+}